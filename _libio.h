@@ -15,35 +15,101 @@ struct iopar {
 	int (*set)(struct iopar *, double value);
 	/* method to refresh value just before get */
 	void (*jitget)(struct iopar *);
+	/* reuse the jitget value, see iopar_set_maxage() */
+	double maxage;
+	/* cycle & time of the last jitget, cycle 0 for none */
+	unsigned long jitcycle;
+	double jittime;
 	/* direct event notification */
 	struct iopar_notifier {
 		struct iopar_notifier *next;
 		void *dat;
 		void (*fn)(void *dat);
+		/* higher priority is called first */
+		int prio;
+		int flags;
+		double delta;
+		/* value at the last notification, and at the last call */
+		double value, called;
+		int present;
 	} *notifiers;
 };
 
+/* remember a dirty iopar for libio_flush() & libio_run_notifiers() */
+extern void libio_push_dirty(struct iopar *iopar);
+
+/* @iopar, which may be dirty already, is about to change again:
+ * run the notifiers of the pending changes first,
+ * so that no intermediate value goes unnoticed
+ */
+extern void iopar_notify_pending(struct iopar *iopar);
+
+/* copy @iopar's value & state to the packed store of get_iopars() */
+extern void libio_pack_iopar(struct iopar *iopar);
+
+/* call after every change of value or state */
 static inline void iopar_set_dirty(struct iopar *iopar)
 {
-	iopar->state |= ST_DIRTY;
+	if (!(iopar->state & ST_DIRTY)) {
+		iopar->state |= ST_DIRTY;
+		libio_push_dirty(iopar);
+	} else
+		/* changed again */
+		libio_pack_iopar(iopar);
 }
 
 static inline void iopar_set_present(struct iopar *iopar)
 {
-	if (!(iopar->state & ST_PRESENT))
-		iopar->state |= ST_PRESENT | ST_DIRTY;
+	if (!(iopar->state & ST_PRESENT)) {
+		iopar->state |= ST_PRESENT;
+		iopar_set_dirty(iopar);
+	}
 }
 
 static inline void iopar_clr_present(struct iopar *iopar)
 {
-	if (iopar->state & ST_PRESENT)
-		iopar->state = (iopar->state | ST_DIRTY) & ~ST_PRESENT;
+	if (iopar->state & ST_PRESENT) {
+		iopar->state &= ~ST_PRESENT;
+		iopar_set_dirty(iopar);
+	}
 }
 
 extern int libio_trace;
 
 extern void netio_sync(void);
+/* netio_sync() without flushing the message queue */
+extern void netio_sync_params(void);
 extern void longdet_flush(void);
+/* recompute the queued derived iopars, returns the number recomputed */
+extern int expr_flush(void);
+/* queue the derived iopars that use @iopar */
+extern void expr_queue_inputs(struct iopar *iopar);
+
+/* event loop instrumentation */
+/* set once the loop stats are requested */
+extern int loopstat_on;
+extern void loopstat_mark(int phase);
+extern void loopstat_events(int nevents);
+extern void loopstat_callback(void *fn, double elapsed);
+extern int loopstat_format(char *buf, int size);
+
+/* string index, to find objects by name
+ * @owner separates the namespaces, the last added @dat is found first
+ */
+extern void libio_index_add(const void *owner, const char *key, void *dat);
+extern void *libio_index_find(const void *owner, const char *key);
+extern void libio_index_del(const void *owner, const char *key, void *dat);
+
+/* allocators for iopar objects & their strings,
+ * from the current arena (see libio_set_arena()), or from the heap
+ */
+extern void *iopar_zalloc(unsigned int size);
+extern char *iopar_strdup(const char *str);
+extern char *iopar_asprintf(const char *fmt, ...)
+	__attribute__((format(printf,1,2)));
+extern void iopar_free(void *ptr);
+/* register a new iopar in the current arena */
+extern void arena_add_iopar(int iopar_id);
 
 /* raw create function */
 extern struct iopar *create_libiopar(const char *str);
@@ -56,6 +122,15 @@ extern void cleanup_libiopar(struct iopar *iopar);
 
 /* direct event notifications */
 extern int iopar_add_notifier(int iopar, void (*)(void *), void *dat);
+/* notifier that is only called for the changes in @flags,
+ * or for any change when @flags is 0
+ */
+#define IOPAR_NF_RISING		0x01 /* boolean value goes 0 -> 1 */
+#define IOPAR_NF_FALLING	0x02 /* boolean value goes 1 -> 0 */
+#define IOPAR_NF_DELTA		0x04 /* value moved >= @delta since the last call */
+#define IOPAR_NF_PRESENT	0x08 /* parameter got lost or present */
+extern int iopar_add_notifier_flags(int iopar, void (*)(void *), void *dat,
+		int flags, int prio, double delta);
 extern int iopar_del_notifier(int iopar, void (*)(void *), void *dat);
 
 /* real parameter constructors */
@@ -73,6 +148,7 @@ extern struct iopar *mkmotordir(char *str);
 extern struct iopar *mkmotorpos(char *str);
 extern struct iopar *mkteleruptor(char *str);
 extern struct iopar *mkvirtualteleruptor(char *str);
+extern struct iopar *mkexpr(char *str);
 
 extern struct iopar *mknetiolocal(char *name);
 extern struct iopar *mknetiounix(char *uri);
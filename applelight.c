@@ -69,14 +69,14 @@ static void del_applelight(struct iopar *iopar)
 
 	libt_remove_timeout(applelight_timeout, al);
 	cleanup_libiopar(&al->iopar);
-	free(al);
+	iopar_free(al);
 }
 
 struct iopar *mkapplelight(char *sysfs)
 {
 	struct applelight *al;
 
-	al = zalloc(sizeof(*al) + strlen(sysfs));
+	al = iopar_zalloc(sizeof(*al) + strlen(sysfs));
 	al->iopar.del = del_applelight;
 	al->iopar.set = NULL;
 	/* force the first read to mark value as dirty */
@@ -85,6 +85,6 @@ struct iopar *mkapplelight(char *sysfs)
 
 	/* read initial value & schedule next */
 	applelight_read(al, 1);
-	libt_add_timeout(1, applelight_timeout, al);
+	libt_add_timeout_slack(1, 0.125, applelight_timeout, al);
 	return &al->iopar;
 }
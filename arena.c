@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#include "_libio.h"
+
+/*
+ * arenas: iopars created while an arena is set get their objects
+ * and strings from big chunks. iopar_free() does not return memory
+ * to an arena, libio_arena_free() releases all at once.
+ */
+#define CHUNKSIZE	4096
+#define ALIGN		16
+
+struct chunk {
+	struct chunk *next;
+	unsigned int size, used;
+	/* keep data aligned */
+	char data[] __attribute__((aligned(ALIGN)));
+};
+
+struct libio_arena {
+	struct chunk *chunks;
+	unsigned long used, size;
+	int nchunks;
+	/* ids of the iopars created in this arena */
+	int *ids;
+	int nids, idssize;
+};
+
+/* every allocation starts with a header */
+struct header {
+	struct libio_arena *arena;
+	unsigned int size;
+} __attribute__((aligned(ALIGN)));
+
+static struct libio_arena *current;
+/* live bytes on the heap */
+static unsigned long heapused;
+
+struct libio_arena *libio_arena_new(void)
+{
+	return zalloc(sizeof(struct libio_arena));
+}
+
+struct libio_arena *libio_set_arena(struct libio_arena *arena)
+{
+	struct libio_arena *saved = current;
+
+	current = arena;
+	return saved;
+}
+
+void libio_arena_free(struct libio_arena *arena)
+{
+	struct libio_arena *saved;
+	struct chunk *chunk;
+
+	if (!arena)
+		return;
+	/* iopars created while destroying go to the heap */
+	saved = libio_set_arena(NULL);
+	/* destroy in reverse order, iopars destroy their children first */
+	while (arena->nids)
+		destroy_iopar(arena->ids[--arena->nids]);
+	libio_set_arena((saved == arena) ? NULL : saved);
+
+	while (arena->chunks) {
+		chunk = arena->chunks;
+		arena->chunks = chunk->next;
+		free(chunk);
+	}
+	if (arena->ids)
+		free(arena->ids);
+	free(arena);
+}
+
+void libio_get_arenastat(struct libio_arena *arena, struct libio_arenastat *st)
+{
+	memset(st, 0, sizeof(*st));
+	if (!arena) {
+		st->used = st->size = heapused;
+		return;
+	}
+	st->used = arena->used;
+	st->size = arena->size;
+	st->nchunks = arena->nchunks;
+	st->niopars = arena->nids;
+}
+
+/* remember iopars created in the current arena */
+void arena_add_iopar(int iopar_id)
+{
+	struct libio_arena *arena = current;
+
+	if (!arena)
+		return;
+	if (arena->nids >= arena->idssize) {
+		arena->idssize = arena->idssize ? arena->idssize*2 : 16;
+		arena->ids = realloc(arena->ids, sizeof(*arena->ids)*arena->idssize);
+		if (!arena->ids)
+			elog(LOG_CRIT, errno, "realloc");
+	}
+	arena->ids[arena->nids++] = iopar_id;
+}
+
+static void *arena_alloc(struct libio_arena *arena, unsigned int size)
+{
+	struct chunk *chunk = arena->chunks;
+	void *ptr;
+
+	size = (size + ALIGN -1) & ~(ALIGN -1);
+	if (!chunk || (chunk->used + size > chunk->size)) {
+		unsigned int chunksize = (size > CHUNKSIZE) ? size : CHUNKSIZE;
+
+		chunk = zalloc(sizeof(*chunk) + chunksize);
+		chunk->size = chunksize;
+		if (arena->chunks && (size > CHUNKSIZE)) {
+			/* keep using the partial chunk on top */
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+		arena->size += chunksize;
+		++arena->nchunks;
+	}
+	ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	arena->used += size;
+	return ptr;
+}
+
+/* allocators for iopar objects */
+void *iopar_zalloc(unsigned int size)
+{
+	struct header *hdr;
+
+	size += sizeof(*hdr);
+	if (current)
+		/* chunks are zeroed already */
+		hdr = arena_alloc(current, size);
+	else {
+		hdr = zalloc(size);
+		heapused += size;
+	}
+	hdr->arena = current;
+	hdr->size = size;
+	return hdr+1;
+}
+
+void iopar_free(void *ptr)
+{
+	struct header *hdr = (struct header *)ptr - 1;
+
+	if (!ptr || hdr->arena)
+		/* released with the arena */
+		return;
+	heapused -= hdr->size;
+	free(hdr);
+}
+
+char *iopar_strdup(const char *str)
+{
+	return strcpy(iopar_zalloc(strlen(str)+1), str);
+}
+
+char *iopar_asprintf(const char *fmt, ...)
+{
+	va_list va;
+	char *str;
+	int len;
+
+	va_start(va, fmt);
+	len = vsnprintf(NULL, 0, fmt, va);
+	va_end(va);
+	str = iopar_zalloc(len+1);
+	va_start(va, fmt);
+	vsnprintf(str, len+1, fmt, va);
+	va_end(va);
+	return str;
+}
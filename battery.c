@@ -79,7 +79,7 @@ static void del_batpar(struct iopar *iopar)
 
 	libt_remove_timeout(batpar_timeout, bp);
 	cleanup_libiopar(&bp->iopar);
-	free(bp);
+	iopar_free(bp);
 }
 
 struct iopar *mkbatterypar(char *spec)
@@ -88,7 +88,7 @@ struct iopar *mkbatterypar(char *spec)
 	const char *tok;
 	int flag;
 
-	bp = zalloc(sizeof(*bp) + strlen(spec));
+	bp = iopar_zalloc(sizeof(*bp) + strlen(spec));
 	bp->iopar.del = del_batpar;
 	strcpy(bp->saved, spec);
 	bp->delay = 60;
@@ -117,6 +117,7 @@ struct iopar *mkbatterypar(char *spec)
 
 	/* read initial value & schedule next */
 	batpar_read(bp, 1);
-	libt_add_timeout(bp->delay, batpar_timeout, bp);
+	/* battery levels change slowly, allow to share wakeups */
+	libt_add_timeout_slack(bp->delay, bp->delay / 8, batpar_timeout, bp);
 	return &bp->iopar;
 }
@@ -87,6 +87,9 @@ static void load_consts_file(const char *file)
 		s.last = ptr;
 		if (!s.first)
 			s.first = ptr;
+		/* the first definition wins */
+		if (!libio_index_find(&s, ptr->key))
+			libio_index_add(&s, ptr->key, ptr);
 
 		if (libio_trace >= 2)
 			fprintf(stderr, "%s: %s\t%s\n", file, key, value);
@@ -112,6 +115,7 @@ static void free_consts(void)
 	while (s.first) {
 		ptr = s.first;
 		s.first = ptr->next;
+		libio_index_del(&s, ptr->key, ptr);
 		free(ptr);
 	}
 }
@@ -123,10 +127,9 @@ const char *libio_strconst(const char *name)
 	if (!s.loaded)
 		load_consts();
 
-	for (ptr = s.first; ptr; ptr = ptr->next) {
-		if (!strcmp(name, ptr->key))
-			return ptr->value;
-	}
+	ptr = libio_index_find(&s, name);
+	if (ptr)
+		return ptr->value;
 	/* warn, and add fake entry */
 	elog(LOG_NOTICE, 0, "%s '%s' not found", __func__, name);
 	return NULL;
@@ -202,8 +202,8 @@ static void cpu_timer(void *data)
 			iopar_clr_present(&cp->iopar);
 	}
 
-	/* schedule next */
-	libt_add_timeout(1, cpu_timer, data);
+	/* schedule next, the load is relative so exact timing is not needed */
+	libt_add_timeout_slack(1, 0.125, cpu_timer, data);
 }
 
 /* CPU parameters */
@@ -223,14 +223,14 @@ static void del_cpupar(struct iopar *iopar)
 	if (!cpupars)
 		libt_remove_timeout(cpu_timer, NULL);
 	cleanup_libiopar(&cp->iopar);
-	free(cp);
+	iopar_free(cp);
 }
 
 struct iopar *mkcpupar(char *desc)
 {
 	struct cpupar *cp;
 
-	cp = zalloc(sizeof(*cp));
+	cp = iopar_zalloc(sizeof(*cp));
 	cp->iopar.del = del_cpupar;
 	cp->iopar.set = NULL;
 	/* force the first read to mark value as dirty */
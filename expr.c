@@ -0,0 +1,544 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+
+#include "_libio.h"
+
+/*
+ * derived parameters: expr:EXPRESSION
+ *
+ * EXPRESSION is C-like, with + - * / % < <= > >= == != && || ! ?:
+ * min(a,b), max(a,b), abs(a) and parentheses.
+ * Other iopars are referenced as {SPEC}, e.g.
+ *	expr:{netio:light} && !{unix:/run/ha2#away}
+ * SPEC is looked up by name first, and created (and owned) otherwise.
+ * Bare words are consts, see libio_const().
+ *
+ * The expression is compiled into postfix code. Expressions that
+ * reference other expressions form a DAG, ranked by level.
+ * Changed inputs queue the expression, and expr_flush() recomputes
+ * the queue in level order, so every expression is computed once
+ * per round, after all its inputs.
+ */
+
+enum {
+	OP_CONST,
+	OP_INPUT,
+	OP_NEG, OP_NOT, OP_ABS,
+	OP_MUL, OP_DIV, OP_MOD, OP_ADD, OP_SUB,
+	OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+	OP_AND, OP_OR, OP_MIN, OP_MAX,
+	OP_COND,
+};
+
+struct op {
+	int code;
+	union {
+		double value;
+		int input;
+	};
+};
+
+struct input {
+	int id;
+	int owned;
+};
+
+struct expr {
+	struct iopar iopar;
+	/* queued for recompute */
+	struct expr *nextpending;
+	int pending;
+	/* 1 + highest level of the expressions in the inputs */
+	int level;
+	struct op *code;
+	int ncode, maxdepth;
+	struct input *inputs;
+	int ninputs;
+	/* expressions that use me */
+	struct expr **deps;
+	int ndeps;
+};
+
+/* queue, sorted by level */
+static struct expr *pending;
+
+/* compiler */
+struct compiler {
+	const char *pos;
+	struct expr *expr;
+	int depth;
+	int size;
+	int err;
+};
+
+static void del_expr(struct iopar *iopar);
+static int parse_cond(struct compiler *c);
+
+static inline struct expr *iopar2expr(struct iopar *iopar)
+{
+	return (iopar && iopar->del == del_expr) ? (struct expr *)iopar : NULL;
+}
+
+static int compile_error(struct compiler *c, const char *msg)
+{
+	if (!c->err)
+		elog(LOG_WARNING, 0, "expr: %s at '%s'", msg, c->pos);
+	c->err = 1;
+	return -1;
+}
+
+static void emit(struct compiler *c, int code, int depth)
+{
+	struct expr *expr = c->expr;
+
+	if (expr->ncode >= c->size) {
+		c->size = c->size ? c->size*2 : 16;
+		expr->code = realloc(expr->code, sizeof(*expr->code)*c->size);
+		if (!expr->code)
+			elog(LOG_CRIT, errno, "realloc");
+	}
+	expr->code[expr->ncode].code = code;
+	expr->code[expr->ncode].value = 0;
+	++expr->ncode;
+	/* track the stack depth during evaluation */
+	c->depth += depth;
+	if (c->depth > expr->maxdepth)
+		expr->maxdepth = c->depth;
+}
+
+static void skipspace(struct compiler *c)
+{
+	while (isspace(*c->pos))
+		++c->pos;
+}
+
+static int accept(struct compiler *c, const char *tok)
+{
+	int len = strlen(tok);
+
+	skipspace(c);
+	if (strncmp(c->pos, tok, len))
+		return 0;
+	/* don't take '<' from '<=', or '!' from '!=' */
+	if (len == 1 && strchr("<>!=", *tok) && c->pos[1] == '=')
+		return 0;
+	c->pos += len;
+	return 1;
+}
+
+static int add_input(struct compiler *c, const char *spec)
+{
+	struct expr *expr = c->expr;
+	struct input *in;
+	int id, owned = 0;
+
+	id = iopar_find(spec);
+	if (id <= 0) {
+		id = create_iopar(spec);
+		if (id <= 0)
+			return compile_error(c, "bad parameter");
+		owned = 1;
+	}
+	expr->inputs = realloc(expr->inputs,
+			sizeof(*expr->inputs)*(expr->ninputs+1));
+	if (!expr->inputs)
+		elog(LOG_CRIT, errno, "realloc");
+	in = &expr->inputs[expr->ninputs];
+	in->id = id;
+	in->owned = owned;
+	return expr->ninputs++;
+}
+
+static int parse_primary(struct compiler *c)
+{
+	const char *end;
+	char *endp, *spec;
+	int j, nest, code;
+	double value;
+
+	skipspace(c);
+	if (accept(c, "(")) {
+		if (parse_cond(c) < 0)
+			return -1;
+		if (!accept(c, ")"))
+			return compile_error(c, "')' expected");
+		return 0;
+	}
+	if (*c->pos == '{') {
+		/* find the matching brace */
+		for (end = c->pos+1, nest = 1; *end; ++end) {
+			if (*end == '{')
+				++nest;
+			else if (*end == '}' && !--nest)
+				break;
+		}
+		if (!*end)
+			return compile_error(c, "'}' expected");
+		spec = strndupa(c->pos+1, end - c->pos - 1);
+		j = add_input(c, spec);
+		if (j < 0)
+			return -1;
+		emit(c, OP_INPUT, +1);
+		c->expr->code[c->expr->ncode-1].input = j;
+		c->pos = end+1;
+		return 0;
+	}
+	if (isdigit(*c->pos) || *c->pos == '.') {
+		value = strtod(c->pos, &endp);
+		if (endp == c->pos)
+			return compile_error(c, "bad number");
+		c->pos = endp;
+		emit(c, OP_CONST, +1);
+		c->expr->code[c->expr->ncode-1].value = value;
+		return 0;
+	}
+	if (isalpha(*c->pos) || *c->pos == '_') {
+		for (end = c->pos; isalnum(*end) || *end == '_'; ++end);
+		spec = strndupa(c->pos, end - c->pos);
+		c->pos = end;
+
+		if (!strcmp(spec, "min"))
+			code = OP_MIN;
+		else if (!strcmp(spec, "max"))
+			code = OP_MAX;
+		else if (!strcmp(spec, "abs"))
+			code = OP_ABS;
+		else {
+			/* constant */
+			value = libio_const(spec);
+			if (isnan(value))
+				return compile_error(c, "unknown const");
+			emit(c, OP_CONST, +1);
+			c->expr->code[c->expr->ncode-1].value = value;
+			return 0;
+		}
+		if (!accept(c, "("))
+			return compile_error(c, "'(' expected");
+		if (parse_cond(c) < 0)
+			return -1;
+		if (code != OP_ABS) {
+			if (!accept(c, ","))
+				return compile_error(c, "',' expected");
+			if (parse_cond(c) < 0)
+				return -1;
+		}
+		if (!accept(c, ")"))
+			return compile_error(c, "')' expected");
+		emit(c, code, (code == OP_ABS) ? 0 : -1);
+		return 0;
+	}
+	return compile_error(c, "operand expected");
+}
+
+static int parse_unary(struct compiler *c)
+{
+	if (accept(c, "-")) {
+		if (parse_unary(c) < 0)
+			return -1;
+		emit(c, OP_NEG, 0);
+		return 0;
+	}
+	if (accept(c, "!")) {
+		if (parse_unary(c) < 0)
+			return -1;
+		emit(c, OP_NOT, 0);
+		return 0;
+	}
+	if (accept(c, "+"))
+		return parse_unary(c);
+	return parse_primary(c);
+}
+
+/* binary operators, by precedence, highest first */
+static const struct binop {
+	const char *tok;
+	int code;
+} binops[][7] = {
+	{ { "*", OP_MUL, }, { "/", OP_DIV, }, { "%", OP_MOD, }, },
+	{ { "+", OP_ADD, }, { "-", OP_SUB, }, },
+	{ { "<=", OP_LE, }, { ">=", OP_GE, }, { "<", OP_LT, }, { ">", OP_GT, },
+	  { "==", OP_EQ, }, { "!=", OP_NE, }, },
+	{ { "&&", OP_AND, }, },
+	{ { "||", OP_OR, }, },
+};
+#define NPRECS	(sizeof(binops)/sizeof(binops[0]))
+
+static int parse_binary(struct compiler *c, int prec)
+{
+	const struct binop *op;
+
+	if ((prec ? parse_binary(c, prec-1) : parse_unary(c)) < 0)
+		return -1;
+	for (;;) {
+		for (op = binops[prec]; op->tok; ++op) {
+			if (accept(c, op->tok))
+				break;
+		}
+		if (!op->tok)
+			return 0;
+		if ((prec ? parse_binary(c, prec-1) : parse_unary(c)) < 0)
+			return -1;
+		emit(c, op->code, -1);
+	}
+}
+
+static int parse_cond(struct compiler *c)
+{
+	if (parse_binary(c, NPRECS-1) < 0)
+		return -1;
+	if (!accept(c, "?"))
+		return 0;
+	if (parse_cond(c) < 0)
+		return -1;
+	if (!accept(c, ":"))
+		return compile_error(c, "':' expected");
+	if (parse_cond(c) < 0)
+		return -1;
+	emit(c, OP_COND, -2);
+	return 0;
+}
+
+/* evaluation */
+static double eval_expr(struct expr *expr)
+{
+	double stack[expr->maxdepth+1], *sp = stack, values[expr->ninputs+1];
+	const struct op *op;
+	int j;
+
+	for (j = 0; j < expr->ninputs; ++j)
+		values[j] = get_iopar(expr->inputs[j].id);
+
+	for (op = expr->code; op < expr->code + expr->ncode; ++op) {
+		switch (op->code) {
+		case OP_CONST:
+			*sp++ = op->value;
+			break;
+		case OP_INPUT:
+			*sp++ = values[op->input];
+			break;
+		case OP_NEG:
+			sp[-1] = -sp[-1];
+			break;
+		case OP_NOT:
+			sp[-1] = isnan(sp[-1]) ? NAN : !sp[-1];
+			break;
+		case OP_ABS:
+			sp[-1] = fabs(sp[-1]);
+			break;
+		case OP_COND:
+			sp -= 2;
+			sp[-1] = isnan(sp[-1]) ? NAN : sp[-1] ? sp[0] : sp[1];
+			break;
+		default:
+			/* binary operators */
+			--sp;
+			switch (op->code) {
+			case OP_MUL: sp[-1] *= sp[0]; break;
+			case OP_DIV: sp[-1] /= sp[0]; break;
+			case OP_MOD: sp[-1] = fmod(sp[-1], sp[0]); break;
+			case OP_ADD: sp[-1] += sp[0]; break;
+			case OP_SUB: sp[-1] -= sp[0]; break;
+			case OP_LT: sp[-1] = sp[-1] < sp[0]; break;
+			case OP_LE: sp[-1] = sp[-1] <= sp[0]; break;
+			case OP_GT: sp[-1] = sp[-1] > sp[0]; break;
+			case OP_GE: sp[-1] = sp[-1] >= sp[0]; break;
+			case OP_EQ: sp[-1] = sp[-1] == sp[0]; break;
+			case OP_NE: sp[-1] = sp[-1] != sp[0]; break;
+			/* booleans test like set_iopar, >= 0.5 */
+			case OP_AND: sp[-1] = (sp[-1] >= 0.5) && (sp[0] >= 0.5); break;
+			case OP_OR: sp[-1] = (sp[-1] >= 0.5) || (sp[0] >= 0.5); break;
+			case OP_MIN: sp[-1] = fmin(sp[-1], sp[0]); break;
+			case OP_MAX: sp[-1] = fmax(sp[-1], sp[0]); break;
+			}
+			break;
+		}
+	}
+	return stack[0];
+}
+
+/* recompute, and queue my dependents when changed */
+static void queue_expr(struct expr *expr);
+
+static void update_expr(struct expr *expr)
+{
+	double saved_value = expr->iopar.value;
+	int j, saved_state = expr->iopar.state, present = 1;
+
+	expr->iopar.value = eval_expr(expr);
+	for (j = 0; j < expr->ninputs; ++j) {
+		if (iopar_present(expr->inputs[j].id) <= 0)
+			present = 0;
+	}
+	/* present when all inputs are present */
+	if (present)
+		iopar_set_present(&expr->iopar);
+	else
+		iopar_clr_present(&expr->iopar);
+	if ((saved_value != expr->iopar.value) &&
+			!(isnan(saved_value) && isnan(expr->iopar.value)))
+		iopar_set_dirty(&expr->iopar);
+	else if (!((saved_state ^ expr->iopar.state) & ST_PRESENT))
+		/* nothing changed */
+		return;
+	for (j = 0; j < expr->ndeps; ++j)
+		queue_expr(expr->deps[j]);
+}
+
+static void queue_expr(struct expr *expr)
+{
+	struct expr **pexpr;
+
+	if (expr->pending)
+		return;
+	for (pexpr = &pending; *pexpr; pexpr = &(*pexpr)->nextpending) {
+		if ((*pexpr)->level > expr->level)
+			break;
+	}
+	expr->nextpending = *pexpr;
+	*pexpr = expr;
+	expr->pending = 1;
+}
+
+static void unqueue_expr(struct expr *expr)
+{
+	struct expr **pexpr;
+
+	for (pexpr = &pending; *pexpr; pexpr = &(*pexpr)->nextpending) {
+		if (*pexpr == expr) {
+			*pexpr = expr->nextpending;
+			break;
+		}
+	}
+	expr->pending = 0;
+}
+
+int expr_flush(void)
+{
+	struct expr *expr;
+	int n;
+
+	/* dependents are queued behind me, since their level is higher */
+	for (n = 0; pending; ++n) {
+		expr = pending;
+		pending = expr->nextpending;
+		expr->pending = 0;
+		update_expr(expr);
+	}
+	return n;
+}
+
+static void expr_input_changed(void *dat)
+{
+	queue_expr(dat);
+}
+
+/* @iopar changed outside the notifiers, e.g. by the application */
+void expr_queue_inputs(struct iopar *iopar)
+{
+	struct iopar_notifier *notifier;
+
+	for (notifier = iopar->notifiers; notifier; notifier = notifier->next) {
+		if (notifier->fn == expr_input_changed)
+			queue_expr(notifier->dat);
+	}
+}
+
+/* dependency administration */
+static void add_dep(struct expr *expr, struct expr *dep)
+{
+	expr->deps = realloc(expr->deps, sizeof(*expr->deps)*(expr->ndeps+1));
+	if (!expr->deps)
+		elog(LOG_CRIT, errno, "realloc");
+	expr->deps[expr->ndeps++] = dep;
+}
+
+static void del_dep(struct expr *expr, struct expr *dep)
+{
+	int j;
+
+	for (j = 0; j < expr->ndeps; ++j) {
+		if (expr->deps[j] == dep) {
+			expr->deps[j] = expr->deps[--expr->ndeps];
+			break;
+		}
+	}
+}
+
+static void release_inputs(struct expr *expr)
+{
+	struct expr *in;
+	int j;
+
+	for (j = 0; j < expr->ninputs; ++j) {
+		in = iopar2expr(lookup_iopar(expr->inputs[j].id));
+		if (in)
+			del_dep(in, expr);
+		else
+			iopar_del_notifier(expr->inputs[j].id, expr_input_changed, expr);
+		if (expr->inputs[j].owned)
+			destroy_iopar(expr->inputs[j].id);
+	}
+}
+
+static void del_expr(struct iopar *iopar)
+{
+	struct expr *expr = (struct expr *)iopar;
+
+	if (expr->pending)
+		unqueue_expr(expr);
+	release_inputs(expr);
+	if (expr->inputs)
+		free(expr->inputs);
+	if (expr->deps)
+		free(expr->deps);
+	if (expr->code)
+		free(expr->code);
+	cleanup_libiopar(&expr->iopar);
+	iopar_free(expr);
+}
+
+struct iopar *mkexpr(char *str)
+{
+	struct expr *expr, *in;
+	struct compiler c = { .pos = str, };
+	int j;
+
+	expr = iopar_zalloc(sizeof(*expr));
+	expr->iopar.del = del_expr;
+	expr->iopar.value = NAN;
+	c.expr = expr;
+
+	if (parse_cond(&c) < 0)
+		goto fail;
+	skipspace(&c);
+	if (*c.pos) {
+		compile_error(&c, "garbage");
+		goto fail;
+	}
+	/* hook into the inputs */
+	for (j = 0; j < expr->ninputs; ++j) {
+		in = iopar2expr(lookup_iopar(expr->inputs[j].id));
+		if (in) {
+			add_dep(in, expr);
+			if (in->level >= expr->level)
+				expr->level = in->level +1;
+		} else
+			iopar_add_notifier(expr->inputs[j].id, expr_input_changed, expr);
+	}
+	update_expr(expr);
+	return &expr->iopar;
+
+fail:
+	/* no notifiers nor dependencies have been registered yet */
+	for (j = 0; j < expr->ninputs; ++j) {
+		if (expr->inputs[j].owned)
+			destroy_iopar(expr->inputs[j].id);
+	}
+	expr->ninputs = 0;
+	del_expr(&expr->iopar);
+	return NULL;
+}
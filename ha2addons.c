@@ -19,6 +19,7 @@
 
 /* definitions */
 #define HOUR *3600
+#define ARRAY_SIZE(x)	(sizeof(x)/sizeof((x)[0]))
 
 /* ARGUMENTS */
 static const char help_msg[] =
@@ -100,9 +101,13 @@ static inline int btnpushed(int iopar)
 static inline int btnspushed(const int *iopars, int niopars)
 {
 	int j;
+	/* at least 1 word, a VLA of 0 length is undefined */
+	unsigned long dirty[IOPAR_MASK_WORDS((niopars > 0) ? niopars : 1)];
 
+	if (!iopar_dirty_mask(iopars, niopars, dirty))
+		return 0;
 	for (j = 0; j < niopars; ++j) {
-		if (btnpushed(iopars[j]))
+		if (iopar_mask_test(dirty, j) && active(iopars[j]))
 			return 1;
 	}
 	return 0;
@@ -111,9 +116,13 @@ static inline int btnspushed(const int *iopars, int niopars)
 static inline void set_longdet_btns(int longdet, const int *iopars, int niopars)
 {
 	int j;
+	/* at least 1 word, a VLA of 0 length is undefined */
+	unsigned long dirty[IOPAR_MASK_WORDS((niopars > 0) ? niopars : 1)];
 
+	if (!iopar_dirty_mask(iopars, niopars, dirty))
+		return;
 	for (j = 0; j < niopars; ++j) {
-		if (iopar_dirty(iopars[j])) {
+		if (iopar_mask_test(dirty, j)) {
 			set_longdet(longdet, get_iopar(iopars[j]));
 			break;
 		}
@@ -242,6 +251,13 @@ static int ha2addons(int argc, char *argv[])
 	s.veluxlgpos = create_iopar("veluxlgpos");
 	s.veluxhpos = create_iopar("veluxhpos");
 	s.veluxlpos = create_iopar("veluxlpos");
+	/* active() reads these several times per cycle */
+	iopar_set_maxage(s.main, IOPAR_MAXAGE_CYCLE);
+	iopar_set_maxage(s.lavabo, IOPAR_MAXAGE_CYCLE);
+	iopar_set_maxage(s.bad, IOPAR_MAXAGE_CYCLE);
+	iopar_set_maxage(s.bluebad, IOPAR_MAXAGE_CYCLE);
+	iopar_set_maxage(s.blueled, IOPAR_MAXAGE_CYCLE);
+	iopar_set_maxage(s.hal, IOPAR_MAXAGE_CYCLE);
 
 	s.badk[0] = create_iopar("badk1");
 	s.badk[1] = create_iopar("badk2");
@@ -333,38 +349,36 @@ static int ha2addons(int argc, char *argv[])
 		set_longdet_btns(ldmain, s.imain, NMAIN);
 		if (longdet_edge(ldmain) && (longdet_state(ldmain) == LONGPRESS)) {
 			/* all off */
-			set_iopar(s.led, 0);
-			set_iopar(s.zolder, 0);
-			set_iopar(s.fan, 0);
-			set_iopar(s.lavabo, 0);
-			set_iopar(s.bad, 0);
-			set_iopar(s.bluebad, 0);
-			set_iopar(s.main, 0);
-			set_iopar(s.blueled, 0);
-			set_iopar(s.hal, 0);
+			int alloff[] = { s.led, s.zolder, s.fan, s.lavabo, s.bad,
+				s.bluebad, s.main, s.blueled, s.hal, };
+			double zero[ARRAY_SIZE(alloff)] = {};
+
+			libio_begin();
+			set_iopar_v(alloff, zero, ARRAY_SIZE(alloff));
+			libio_commit();
 		} else if (longdet_edge(ldmain) && (longdet_state(ldmain) == SHORTPRESS)) {
 			/* toggle */
 			set_iopar(s.main, !active(s.main));
 		}
 
 		if (btnpushed(s.poets)) {
+			libio_begin();
 			if (active(s.main) || active(s.lavabo) ||
 					active(s.blueled) ||
 					active(s.bad) || active(s.hal)) {
 				/* turn a lot off */
-				set_iopar(s.led, 0);
-				set_iopar(s.lavabo, 0);
-				set_iopar(s.bad, 0);
-				set_iopar(s.bluebad, 0);
-				set_iopar(s.main, 0);
-				set_iopar(s.blueled, 0);
-				set_iopar(s.hal, 0);
+				int lotoff[] = { s.led, s.lavabo, s.bad, s.bluebad,
+					s.main, s.blueled, s.hal, };
+				double zero[ARRAY_SIZE(lotoff)] = {};
+
+				set_iopar_v(lotoff, zero, ARRAY_SIZE(lotoff));
 			} else {
 				/* turn some things on */
 				set_iopar(s.lavabo, 1);
 				set_iopar(s.bad, 1);
 				set_iopar(s.main, 1);
 			}
+			libio_commit();
 		}
 
 		/* reset FAN */
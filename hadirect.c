@@ -52,6 +52,7 @@ static struct args {
 static int hadirect(int argc, char *argv[])
 {
 	int opt, j;
+	unsigned long dirty[IOPAR_MASK_WORDS(MAX_IN)];
 	struct link *lnk;
 	char *streq, *tmpstr;
 
@@ -115,8 +116,10 @@ static int hadirect(int argc, char *argv[])
 			} else if (iopar_dirty(lnk->out)) {
 				set_iopar(lnk->pub, get_iopar(lnk->out));
 			}
+			if (!iopar_dirty_mask(lnk->in, lnk->nin, dirty))
+				continue;
 			for (j = 0; j < lnk->nin; ++j) {
-				if (iopar_dirty(lnk->in[j]) &&
+				if (iopar_mask_test(dirty, j) &&
 						(get_iopar(lnk->in[j]) > 0.5)) {
 					/* local button input pressed, toggle */
 					set_iopar(lnk->out, !(int)get_iopar(lnk->out));
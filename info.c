@@ -77,10 +77,47 @@ static int netiomsg_request(int argc, char *argv[])
 	return 1;
 }
 
+/* dump event loop statistics of a remote program */
+static int loopstats(int argc, char *argv[])
+{
+	int id;
+	char *msg, *tok;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s SOCKET\n"
+				"static callbacks are printed as FILE+OFFSET,"
+				" use addr2line -f -e FILE OFFSET\n", argv[0]);
+		exit(1);
+	}
+
+	id = netio_send_msg(argv[1], "*stats");
+	if (id < 0)
+		/* failed */
+		return 1;
+
+	alarm(2);
+	while (1) {
+		while (netio_msg_pending()) {
+			/* fetch message before testing ID! */
+			msg = (char *)netio_recv_msg();
+			if (netio_msg_id() != id)
+				continue;
+			for (tok = strtok(msg, " "); tok; tok = strtok(NULL, " "))
+				printf("%s\n", tok);
+			return 0;
+		}
+
+		if (libio_wait() < 0)
+			break;
+	}
+	return 1;
+}
+
 __attribute__((constructor))
 static void add_default_applets(void)
 {
 	register_applet("consts", libio_consts);
 	register_applet("sendto", netiomsg_sendto);
 	register_applet("request", netiomsg_request);
+	register_applet("loopstats", loopstats);
 }
@@ -86,6 +86,7 @@ static void add_inputdev(struct inputdev *dev)
 {
 	dev->next = inputdevs;
 	inputdevs = dev;
+	libio_index_add(&inputdevs, dev->file, dev);
 }
 
 static void del_inputdev(struct inputdev *dev)
@@ -98,6 +99,7 @@ static void del_inputdev(struct inputdev *dev)
 			break;
 		}
 	}
+	libio_index_del(&inputdevs, dev->file, dev);
 }
 
 /* Device */
@@ -134,9 +136,10 @@ static void evbtn_newdata(struct evbtn *btn, const struct input_event *ev)
 		/* always set the correct value, regardless of signalling */
 		btn->iopar.value = ev->value;
 
-		if (btn->flags & FL_DEBOUNCE)
+		if (btn->flags & FL_DEBOUNCE) {
 			libt_add_timeout(debouncetime, evbtn_debounced, btn);
-		else
+			libio_pack_iopar(&btn->iopar);
+		} else
 			iopar_set_dirty(&btn->iopar);
 	}
 }
@@ -193,10 +196,9 @@ static struct inputdev *lookup_inputdev(const char *spec)
 		spec = file;
 	}
 
-	for (dev = inputdevs; dev; dev = dev->next) {
-		if (!strcmp(dev->file, spec))
-			goto found;
-	}
+	dev = libio_index_find(&inputdevs, spec);
+	if (dev)
+		goto found;
 
 	dev = zalloc(sizeof(*dev) + strlen(spec));
 	strcpy(dev->file, spec);
@@ -228,7 +230,7 @@ static void del_evbtn_hook(struct iopar *iopar)
 		/* this was the last button */
 		free_inputdev(btn->dev);
 	cleanup_libiopar(&btn->iopar);
-	free(btn);
+	iopar_free(btn);
 }
 
 struct iopar *mkinputevbtn(char *str)
@@ -238,7 +240,7 @@ struct iopar *mkinputevbtn(char *str)
 	char *tok;
 	int flag;
 
-	btn = zalloc(sizeof(*btn));
+	btn = iopar_zalloc(sizeof(*btn));
 	btn->iopar.del = del_evbtn_hook;
 	btn->iopar.set = NULL;
 	btn->iopar.value = 0;
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include "lib/libt.h"
+#include "lib/libe.h"
+#include "_libio.h"
+
+/* ARGUMENTS */
+static const char help_msg[] =
+	NAME ": benchmark the libio event loop\n"
+	"Usage: " NAME " [OPTIONS]\n"
+	"\n"
+	"Options:\n"
+	" -t, --timers=NUM	Number of timers (default 100000)\n"
+	" -f, --fds=NUM		Number of socketpairs (default 256)\n"
+	" -p, --params=NUM	Number of dirty parameters (default 1000)\n"
+	" -r, --rounds=NUM	Rounds for fds & parameters (default 1000)\n"
+	;
+
+#ifdef _GNU_SOURCE
+static const struct option long_opts[] = {
+	{ "help", no_argument, NULL, '?', },
+	{ "timers", required_argument, NULL, 't', },
+	{ "fds", required_argument, NULL, 'f', },
+	{ "params", required_argument, NULL, 'p', },
+	{ "rounds", required_argument, NULL, 'r', },
+	{ },
+};
+
+#else
+#define getopt_long(argc, argv, optstring, longopts, longindex) \
+	getopt((argc), (argv), (optstring))
+#endif
+
+static const char optstring[] = "?t:f:p:r:";
+
+static struct {
+	int ntimers;
+	int nfds;
+	int nparams;
+	int nrounds;
+	/* latency samples, in seconds */
+	double *lat;
+	int nlat;
+	/* counters of the callbacks */
+	long hits;
+	double last;
+} s = {
+	.ntimers = 100000,
+	.nfds = 256,
+	.nparams = 1000,
+	.nrounds = 1000,
+};
+
+/* results */
+static int cmpdouble(const void *va, const void *vb)
+{
+	const double *a = va, *b = vb;
+
+	return (*a > *b) - (*a < *b);
+}
+
+static void report(const char *name, long ops, double elapsed)
+{
+	qsort(s.lat, s.nlat, sizeof(*s.lat), cmpdouble);
+	printf("%-16s %10.0f ops/s", name, ops / elapsed);
+	if (s.nlat)
+		printf("  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f usec",
+				s.lat[s.nlat/2]*1e6,
+				s.lat[s.nlat*9/10]*1e6,
+				s.lat[s.nlat*99/100]*1e6,
+				s.lat[s.nlat-1]*1e6);
+	printf("\n");
+	s.nlat = 0;
+}
+
+static inline void sample(double t0, double t1)
+{
+	s.lat[s.nlat++] = t1 - t0;
+}
+
+/* libt */
+static void on_timer(void *dat)
+{
+	double now = libt_now();
+
+	/* latency between consecutive callbacks */
+	sample(s.last, now);
+	s.last = now;
+	++s.hits;
+}
+
+static void bench_libt(void)
+{
+	long j;
+	double t0, t1, start;
+
+	start = libt_now();
+	for (j = 0; j < s.ntimers; ++j) {
+		t0 = libt_now();
+		libt_add_timeout(drand48() * 10, on_timer, (void *)j);
+		sample(t0, libt_now());
+	}
+	report("libt insert", s.ntimers, libt_now() - start);
+
+	start = libt_now();
+	for (j = 0; j < s.ntimers; ++j) {
+		t0 = libt_now();
+		libt_remove_timeout(on_timer, (void *)j);
+		sample(t0, libt_now());
+	}
+	report("libt cancel", s.ntimers, libt_now() - start);
+
+	/* all timers in the past */
+	for (j = 0; j < s.ntimers; ++j)
+		libt_add_timeout(-drand48() * 0.1, on_timer, (void *)j);
+	s.hits = 0;
+	start = s.last = libt_now();
+	libt_flush();
+	t1 = libt_now();
+	if (s.hits != s.ntimers)
+		elog(LOG_ERR, 0, "%li of %i timers fired", s.hits, s.ntimers);
+	report("libt expire", s.ntimers, t1 - start);
+}
+
+/* libe */
+static void on_fd(int fd, void *dat)
+{
+	char buf[16];
+
+	if (read(fd, buf, sizeof(buf)) > 0)
+		++s.hits;
+}
+
+static void bench_libe(void)
+{
+	int j, k, ret, nsent, (*sk)[2];
+	double t0, start;
+	long ops = 0;
+
+	sk = zalloc(sizeof(*sk) * s.nfds);
+	for (j = 0; j < s.nfds; ++j) {
+		if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sk[j]) < 0)
+			elog(LOG_CRIT, errno, "socketpair %i", j);
+		if (libe_add_fd(sk[j][0], on_fd, NULL) < 0)
+			elog(LOG_CRIT, errno, "libe_add_fd %i", j);
+	}
+
+	start = libt_now();
+	for (k = 0; k < s.nrounds; ++k) {
+		for (j = nsent = 0; j < s.nfds; ++j) {
+			if (send(sk[j][1], "x", 1, 0) < 0)
+				elog(LOG_ERR, errno, "send %i", j);
+			else
+				++nsent;
+		}
+		/* dispatch until all arrived, or nothing arrives anymore */
+		t0 = libt_now();
+		for (s.hits = 0; s.hits < nsent; ) {
+			ret = libe_wait(1000);
+			if ((ret < 0) && (errno != EINTR))
+				elog(LOG_CRIT, errno, "libe_wait");
+			if (!ret) {
+				elog(LOG_ERR, 0, "%li of %i datagrams arrived",
+						s.hits, nsent);
+				break;
+			}
+			libe_flush();
+		}
+		sample(t0, libt_now());
+		ops += s.hits;
+	}
+	report("libe dispatch", ops, libt_now() - start);
+
+	for (j = 0; j < s.nfds; ++j) {
+		libe_remove_fd(sk[j][0]);
+		close(sk[j][0]);
+		close(sk[j][1]);
+	}
+	free(sk);
+}
+
+/* libio */
+static void on_param(void *dat)
+{
+	++s.hits;
+}
+
+static void on_cycle(void *dat)
+{
+}
+
+static void bench_libio(void)
+{
+	int j, k, *params;
+	double t0, start;
+
+	params = zalloc(sizeof(*params) * s.nparams);
+	for (j = 0; j < s.nparams; ++j) {
+		params[j] = create_ioparf("netio:bench%i", j);
+		if (params[j] <= 0)
+			elog(LOG_CRIT, 0, "create param %i", j);
+		iopar_add_notifier(params[j], on_param, NULL);
+	}
+	/* flush initial state */
+	libt_add_timeout(0, on_cycle, NULL);
+	libio_wait();
+
+	start = libt_now();
+	for (k = 0; k < s.nrounds; ++k) {
+		for (j = 0; j < s.nparams; ++j)
+			set_iopar(params[j], k);
+		/* don't sleep */
+		libt_add_timeout(0, on_cycle, NULL);
+		s.hits = 0;
+		t0 = libt_now();
+		libio_wait();
+		/* the notifiers run at the end of the cycle */
+		sample(t0, libt_now());
+		if (s.hits != s.nparams)
+			elog(LOG_ERR, 0, "%li of %i notifiers ran", s.hits, s.nparams);
+	}
+	report("libio cycle", s.nrounds, libt_now() - start);
+
+	for (j = 0; j < s.nparams; ++j)
+		destroy_iopar(params[j]);
+	free(params);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, n;
+	struct rlimit rlim;
+
+	while ((opt = getopt_long(argc, argv, optstring, long_opts, NULL)) != -1)
+	switch (opt) {
+	case 't':
+		s.ntimers = strtoul(optarg, NULL, 0);
+		break;
+	case 'f':
+		s.nfds = strtoul(optarg, NULL, 0);
+		break;
+	case 'p':
+		s.nparams = strtoul(optarg, NULL, 0);
+		break;
+	case 'r':
+		s.nrounds = strtoul(optarg, NULL, 0);
+		break;
+	case '?':
+	default:
+		fputs(help_msg, stderr);
+		exit(1);
+		break;
+	}
+
+	/* 2 fds per socketpair */
+	if (!getrlimit(RLIMIT_NOFILE, &rlim) && rlim.rlim_cur < s.nfds*2 + 16) {
+		rlim.rlim_cur = s.nfds*2 + 16;
+		if (setrlimit(RLIMIT_NOFILE, &rlim) < 0)
+			elog(LOG_CRIT, errno, "%i socketpairs", s.nfds);
+	}
+	n = s.ntimers;
+	if (n < s.nrounds)
+		n = s.nrounds;
+	s.lat = zalloc(sizeof(*s.lat) * n);
+
+	printf("%i timers, %i fds, %i params, %i rounds\n",
+			s.ntimers, s.nfds, s.nparams, s.nrounds);
+	bench_libt();
+	bench_libe();
+	bench_libio();
+	return 0;
+}
@@ -36,12 +36,18 @@ static const char optstring[] = "?Vvl:";
 
 struct link {
 	struct link *next;
+	/* index of a in s.ids, b follows */
+	int idx;
 	int a, b;
 };
 
 static struct args {
 	int verbose;
 	struct link *links;
+	/* all ids, for iopar_dirty_mask() */
+	int *ids;
+	int nids;
+	unsigned long *dirty;
 } s;
 
 static int ioserver(int argc, char *argv[])
@@ -83,20 +89,30 @@ static int ioserver(int argc, char *argv[])
 		lnk->next = s.links;
 		s.links = lnk;
 		free(tmpstr);
+		/* add to ids */
+		s.ids = realloc(s.ids, (s.nids + 2) * sizeof(*s.ids));
+		if (!s.ids)
+			elog(LOG_CRIT, errno, "realloc");
+		lnk->idx = s.nids;
+		s.ids[s.nids++] = lnk->a;
+		s.ids[s.nids++] = lnk->b;
 	}
+	s.dirty = zalloc(IOPAR_MASK_WORDS(s.nids) * sizeof(*s.dirty));
 
 	/* main ... */
 	while (1) {
+		if (!iopar_dirty_mask(s.ids, s.nids, s.dirty))
+			goto wait;
 		for (lnk = s.links; lnk; lnk = lnk->next) {
-			if (iopar_dirty(lnk->a)) {
+			if (iopar_mask_test(s.dirty, lnk->idx)) {
 				set_iopar(lnk->b, get_iopar(lnk->a));
 				/* TODO: warn if failed */
 				/* write back in case the real value didn't change */
 				set_iopar(lnk->a, get_iopar(lnk->b));
-			} else if (iopar_dirty(lnk->b))
+			} else if (iopar_mask_test(s.dirty, lnk->idx +1))
 				set_iopar(lnk->a, get_iopar(lnk->b));
 		}
-
+wait:
 		if (libio_wait() < 0)
 			break;
 	}
@@ -60,10 +60,13 @@ static struct args {
 	int verbose;
 	struct ent {
 		int iopar;
-		double value;
 		double mul;
 	} *e;
 	int ne;
+	/* ids & values, for the batch API */
+	int *ids;
+	double *values;
+	unsigned long *dirty;
 	const char *fmt;
 } s;
 
@@ -199,7 +202,7 @@ static int myprint(FILE *fp, const char *fmt)
 		/* proceed format string */
 		fmt = str;
 		/* print */
-		sprintf(strbuf, fmtbuf, s.e[idx].value * s.e[idx].mul);
+		sprintf(strbuf, fmtbuf, s.values[idx] * s.e[idx].mul);
 		++idx;
 		fputs(strbuf, fp);
 		result += strlen(strbuf);
@@ -248,7 +251,6 @@ static void parse_param(struct ent *e, char *str)
 		e->mul = 1;
 	}
 	e->iopar = create_iopar(endp);
-	e->value = NAN;
 }
 
 static void trace_timeout(void *dat)
@@ -319,6 +321,14 @@ static int iotrace(int argc, char *argv[])
 			parse_param(s.e+j, argv[optind]);
 	}
 
+	s.ids = malloc(s.ne * sizeof(*s.ids));
+	s.values = malloc(s.ne * sizeof(*s.values));
+	s.dirty = malloc(IOPAR_MASK_WORDS(s.ne) * sizeof(*s.dirty));
+	for (j = 0; j < s.ne; ++j) {
+		s.ids[j] = s.e[j].iopar;
+		s.values[j] = NAN;
+	}
+
 	libio_set_trace(s.verbose);
 	libt_add_timeout(1.1, trace_timeout, NULL);
 	/* main ... */
@@ -329,10 +339,8 @@ static int iotrace(int argc, char *argv[])
 			fflush(stdout);
 		}
 
-		for (j = 0; j < s.ne; ++j) {
-			if (iopar_dirty(s.e[j].iopar))
-				s.e[j].value = get_iopar(s.e[j].iopar);
-		}
+		if (iopar_dirty_mask(s.ids, s.ne, s.dirty))
+			get_iopar_v(s.ids, s.values, s.ne, s.dirty);
 
 		myprint(stdout, s.fmt);
 		fputc('\n', stdout);
@@ -60,7 +60,8 @@ static void del_led(struct iopar *iopar)
 	struct led *led = (struct led *)iopar;
 
 	cleanup_libiopar(&led->iopar);
-	free(led);
+	iopar_free(led->sysfs);
+	iopar_free(led);
 }
 
 static const char *const led_opts[] = {
@@ -73,8 +74,8 @@ struct iopar *mkled(char *str)
 	struct led *led;
 	const char *name = strtok(str, ",");
 
-	led = zalloc(sizeof(*led));
-	asprintf(&led->sysfs, "/sys/class/leds/%s/brightness", name);
+	led = iopar_zalloc(sizeof(*led));
+	led->sysfs = iopar_asprintf("/sys/class/leds/%s/brightness", name);
 	led->iopar.del = del_led;
 	led->iopar.set = led_set;
 	led->max = attr_read(255, "/sys/class/leds/%s/max_brightness", name);
@@ -97,8 +98,9 @@ struct iopar *mkbacklight(char *str)
 	struct led *led;
 	const char *name = strtok(str, ",");
 
-	led = zalloc(sizeof(*led));
-	asprintf(&led->sysfs, "/sys/class/backlight/%s/brightness", name);
+	led = iopar_zalloc(sizeof(*led));
+	led->sysfs = iopar_asprintf("/sys/class/backlight/%s/brightness", name);
+	led->iopar.del = del_led;
 	led->iopar.set = led_set;
 	led->max = attr_read(255, "/sys/class/backlight/%s/max_brightness", name);
 	/* the default value is read elsewhere compared to leds */
@@ -19,71 +19,211 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include "libe.h"
 
 struct event {
-	struct event *next, *prev;
 	void (*fn)(int fd, void *dat);
 	void *dat;
 	int fd;
+	int flags;
+	/* index in s.evs while an event is queued, or -1 */
+	int evidx;
 };
 
-static struct {
-	struct event *events;
+/* callback posted from another thread */
+struct post {
+	struct post *next;
+	void (*fn)(void *dat);
+	void *dat;
+};
+
+struct libe_loop {
+	/* watched fds, indexed by fd */
+	struct event **fds;
+	int nfds;
 	int epfd; /* epoll file descriptor */
 	int nevs;
+	/* size of the evs array */
+	int maxevs;
 	#define NEVS	16
-	struct epoll_event evs[NEVS];
-} s = {
+	/* limit for growing evs automatically */
+	#define MAXNEVS	1024
+	struct epoll_event *evs;
+	/* LIBE_xxx events of the event being handled */
+	int revents;
+	/* called after each handler, with its duration */
+	void (*hook)(void *fn, double elapsed);
+
+	/* cross-thread wakeup, all below is protected by @lock */
+	pthread_mutex_t lock;
+	int wakefd; /* eventfd, or -1 */
+	struct event wake;
+	struct post *posts, **lastpost;
+};
+
+/* default loop, for the main thread */
+static struct libe_loop e_default = {
 	.epfd = -1,
+	.maxevs = NEVS,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wakefd = -1,
+	.lastpost = &e_default.posts,
 };
 
-/* double-linked-list black magic:
- * The @prev member of the first element points to a 'fake' element
- * which is well-crafted so that assigning prev->next just happens
- * to set the root pointer
- * This function return the required 'fake' pointers
- */
-static inline struct event *t_fakeelement(struct event **root)
+/* loop used by the libe_xxx calls of this thread */
+static __thread struct libe_loop *e_current;
+
+static inline struct libe_loop *e_cur(void)
+{
+	return e_current ?: &e_default;
+}
+
+static inline struct event *e_lookup(struct libe_loop *s, int fd)
+{
+	return ((fd >= 0) && (fd < s->nfds)) ? s->fds[fd] : NULL;
+}
+
+/* translate LIBE_xxx flags from/to epoll events */
+static const struct {
+	int flag;
+	int epoll;
+} e_flags[] = {
+	{ LIBE_ET, EPOLLET, },
+	{ LIBE_IN, EPOLLIN, },
+	{ LIBE_OUT, EPOLLOUT, },
+	{ LIBE_PRI, EPOLLPRI, },
+	{ LIBE_RDHUP, EPOLLRDHUP, },
+	{ LIBE_ERR, EPOLLERR, },
+	{ LIBE_HUP, EPOLLHUP, },
+	{ },
+};
+
+static int e_toepoll(int flags)
 {
-	return (struct event *)(((char *)root) - offsetof(struct event, next));
+	int j, result = 0;
 
+	for (j = 0; e_flags[j].flag; ++j) {
+		if (flags & e_flags[j].flag)
+			result |= e_flags[j].epoll;
+	}
+	return result;
 }
 
-/* double linked list */
-static void t_del(struct event *t)
+static int e_fromepoll(int events)
 {
-	if (t->next)
-		t->next->prev = t->prev;
-	if (t->prev)
-		t->prev->next = t->next;
-	t->next = t->prev = NULL;
+	int j, result = 0;
+
+	for (j = 0; e_flags[j].flag; ++j) {
+		if (events & e_flags[j].epoll)
+			result |= e_flags[j].flag;
+	}
+	return result;
 }
 
-static void t_add(struct event *t, struct event **root)
+static double e_now(void)
 {
-	t_del(t);
-	t->next = *root;
-	if (t->next) {
-		t->prev = t->next->prev;
-		t->next->prev = t;
-	} else
-		/* this is dirty: fake a event struct, which will only be used
-		 * for setting the @next member
-		 */
-		t->prev = t_fakeelement(root);
-	t->prev->next = t;
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + (t.tv_nsec / 1e9);
+}
+
+static int e_register(struct libe_loop *s, struct event *t, int op)
+{
+	struct epoll_event evdat = {
+		.events = e_toepoll(t->flags),
+		.data.ptr = t,
+	};
+
+	return epoll_ctl(s->epfd, op, t->fd, &evdat);
+}
+
+/* run posted callbacks */
+static void e_wakeup(int fd, void *dat)
+{
+	struct libe_loop *s = dat;
+	struct post *post;
+	uint64_t cnt;
+
+	if (read(fd, &cnt, sizeof(cnt)) < 0)
+		/* nothing to do, or spurious */
+		return;
+	pthread_mutex_lock(&s->lock);
+	post = s->posts;
+	s->posts = NULL;
+	s->lastpost = &s->posts;
+	pthread_mutex_unlock(&s->lock);
+
+	while (post) {
+		struct post *next = post->next;
+
+		post->fn(post->dat);
+		free(post);
+		post = next;
+	}
+}
+
+/* create the eventfd, called with @lock held */
+static int e_start_wakeup(struct libe_loop *s)
+{
+	uint64_t one = 1;
+
+	s->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (s->wakefd < 0)
+		return -1;
+	s->wake.fd = s->wakefd;
+	s->wake.flags = LIBE_IN;
+	s->wake.fn = e_wakeup;
+	s->wake.dat = s;
+	s->wake.evidx = -1;
+	if (e_register(s, &s->wake, EPOLL_CTL_ADD) < 0) {
+		close(s->wakefd);
+		s->wakefd = -1;
+		return -1;
+	}
+	if (s->posts)
+		/* posted before the loop started */
+		write(s->wakefd, &one, sizeof(one));
+	return 0;
 }
 
 /* exported API */
-int libe_add_fd(int fd, void (*fn)(int fd, void *), const void *dat)
+int libe_loop_add_fd(struct libe_loop *s, int fd,
+		void (*fn)(int fd, void *), const void *dat)
+{
+	return libe_loop_add_fd_flags(s, fd, 0, fn, dat);
+}
+
+int libe_loop_add_fd_flags(struct libe_loop *s, int fd, int flags,
+		void (*fn)(int fd, void *), const void *dat)
 {
 	struct event *t;
+	int oldnfds;
 
+	if (fd < 0) {
+		errno = EBADF;
+		return -1;
+	}
+	if (e_lookup(s, fd)) {
+		errno = EEXIST;
+		return -1;
+	}
+	if (fd >= s->nfds) {
+		oldnfds = s->nfds;
+		s->nfds = (fd + 16) & ~15;
+		s->fds = realloc(s->fds, sizeof(*s->fds)*s->nfds);
+		/* don't test s->fds, see below */
+		memset(s->fds + oldnfds, 0, sizeof(*s->fds)*(s->nfds - oldnfds));
+	}
 	t = malloc(sizeof(*t));
 	/* don't test t since I don't know what to do if it was NULL
 	 * So, I just use it, and maybe we segfault, which is the best
@@ -91,101 +231,342 @@ int libe_add_fd(int fd, void (*fn)(int fd, void *), const void *dat)
 	 */
 	memset(t, 0, sizeof(*t));
 	t->fd = fd;
+	if (!(flags & LIBE_EVENTS))
+		/* default to input */
+		flags |= LIBE_IN;
+	t->flags = flags;
 	t->fn = fn;
 	t->dat = (void *)dat;
+	t->evidx = -1;
 
-	t_add(t, &s.events);
-	if (s.epfd >= 0) {
-		struct epoll_event evdat = {
-			.events = EPOLLIN,
-			.data.ptr = t,
-		};
+	/* register first, a failure leaves nothing behind */
+	if ((s->epfd >= 0) && (e_register(s, t, EPOLL_CTL_ADD) < 0)) {
+		free(t);
+		return -1;
+	}
+	s->fds[fd] = t;
+	return 0;
+}
 
-		return epoll_ctl(s.epfd, EPOLL_CTL_ADD, fd, &evdat);
+int libe_loop_mod_fd(struct libe_loop *s, int fd, int flags)
+{
+	struct event *t;
+
+	t = e_lookup(s, fd);
+	if (!t) {
+		errno = ENOENT;
+		return -1;
 	}
+	if (!(flags & LIBE_EVENTS))
+		flags |= LIBE_IN;
+	if (t->flags == flags)
+		return 0;
+	t->flags = flags;
+	if (s->epfd >= 0)
+		return e_register(s, t, EPOLL_CTL_MOD);
 	return 0;
 }
 
-void libe_remove_fd(int fd)
+int libe_loop_get_flags(struct libe_loop *s, int fd)
 {
 	struct event *t;
-	int j;
 
-	for (t = s.events; t; t = t->next) {
-		if (t->fd == fd)
-			break;
+	t = e_lookup(s, fd);
+	if (!t) {
+		errno = ENOENT;
+		return -1;
 	}
+	return t->flags;
+}
+
+int libe_loop_revents(struct libe_loop *s)
+{
+	return s->revents;
+}
+
+void libe_loop_remove_fd(struct libe_loop *s, int fd)
+{
+	struct event *t;
+
+	t = e_lookup(s, fd);
 	if (t) {
 		/* alert? */
-		t_del(t);
+		if (t->evidx >= 0)
+			/* clear queued event */
+			s->evs[t->evidx].data.ptr = NULL;
+		s->fds[fd] = NULL;
 		free(t);
-		for (j = 0; j < s.nevs; ++j) {
-			if (s.evs[j].data.ptr == t)
-				/* clear this entry */
-				s.evs[j].data.ptr = NULL;
-		}
 	}
-	if (s.epfd >= 0)
-		epoll_ctl(s.epfd, EPOLL_CTL_DEL, fd, 0);
+	if (s->epfd >= 0)
+		epoll_ctl(s->epfd, EPOLL_CTL_DEL, fd, 0);
+}
+
+int libe_loop_set_maxevents(struct libe_loop *s, int maxevents)
+{
+	struct epoll_event *evs;
+
+	if (maxevents < 1) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (s->nevs) {
+		/* don't drop queued events */
+		errno = EBUSY;
+		return -1;
+	}
+	if (s->evs) {
+		evs = realloc(s->evs, sizeof(*s->evs)*maxevents);
+		if (!evs)
+			return -1;
+		s->evs = evs;
+	}
+	s->maxevs = maxevents;
+	return 0;
 }
 
 /* main run */
-int libe_wait(int waitmsec)
+int libe_loop_wait(struct libe_loop *s, int waitmsec)
 {
-	int ret;
+	int ret, j;
 	struct event *t;
 
-	if (s.epfd < 0) {
+	if (s->epfd < 0) {
 		/* start EPOLL */
-		struct epoll_event evdat = {
-			.events = EPOLLIN,
-		};
-
-		ret = s.epfd = epoll_create(NEVS);
+		ret = s->epfd = epoll_create(NEVS);
 		if (ret < 0)
 			return ret;
-		for (t = s.events; t; t = t->next) {
-			evdat.data.ptr = t;
-			ret = epoll_ctl(s.epfd, EPOLL_CTL_ADD, t->fd, &evdat);
-			if (ret < 0) {
-				close(s.epfd);
-				s.epfd = -1;
-				return ret;
-			}
+		for (j = 0; j < s->nfds; ++j) {
+			if (!s->fds[j])
+				continue;
+			ret = e_register(s, s->fds[j], EPOLL_CTL_ADD);
+			if (ret < 0)
+				goto fail;
 		}
+		pthread_mutex_lock(&s->lock);
+		ret = e_start_wakeup(s);
+		pthread_mutex_unlock(&s->lock);
+		if (ret < 0)
+			goto fail;
+	}
+	if (!s->evs) {
+		s->evs = malloc(sizeof(*s->evs)*s->maxevs);
+		if (!s->evs)
+			return -1;
 	}
 
-	ret = epoll_wait(s.epfd, s.evs, NEVS, waitmsec);
-	s.nevs = (ret >= 0) ? ret : 0;
+	ret = epoll_wait(s->epfd, s->evs, s->maxevs, waitmsec);
+	s->nevs = (ret >= 0) ? ret : 0;
+	for (j = 0; j < s->nevs; ++j) {
+		t = s->evs[j].data.ptr;
+		t->evidx = j;
+	}
+	return ret;
+fail:
+	close(s->epfd);
+	s->epfd = -1;
 	return ret;
 }
 
-void libe_flush(void)
+void libe_loop_flush(struct libe_loop *s)
 {
-	int j;
+	int j, nevs;
 	struct event *t;
 
-	for (j = 0; j < s.nevs; ++j) {
-		if (!s.evs[j].data.ptr)
+	nevs = s->nevs;
+	for (j = 0; j < nevs; ++j) {
+		if (!s->evs[j].data.ptr)
 			// cleared by evt_remove
 			continue;
-		t = s.evs[j].data.ptr;
-		t->fn(t->fd, t->dat);
+		t = s->evs[j].data.ptr;
+		t->evidx = -1;
+		s->revents = e_fromepoll(s->evs[j].events);
+		if (s->hook) {
+			/* t may be gone after the handler */
+			void *fn = t->fn;
+			double t0 = e_now();
+
+			t->fn(t->fd, t->dat);
+			s->hook(fn, e_now() - t0);
+		} else
+			t->fn(t->fd, t->dat);
 	}
-	s.nevs = 0;
+	s->revents = 0;
+	s->nevs = 0;
+	if ((nevs == s->maxevs) && (s->maxevs < MAXNEVS))
+		/* all slots were used, more events may be waiting */
+		libe_loop_set_maxevents(s, s->maxevs*2);
+}
+
+void libe_loop_set_hook(struct libe_loop *s, void (*hook)(void *fn, double elapsed))
+{
+	s->hook = hook;
+}
+
+/* thread-safe calls */
+int libe_loop_post(struct libe_loop *s, void (*fn)(void *), const void *dat)
+{
+	struct post *post;
+	uint64_t one = 1;
+
+	post = malloc(sizeof(*post));
+	if (!post)
+		return -1;
+	post->next = NULL;
+	post->fn = fn;
+	post->dat = (void *)dat;
+
+	pthread_mutex_lock(&s->lock);
+	*s->lastpost = post;
+	s->lastpost = &post->next;
+	if (s->wakefd >= 0)
+		write(s->wakefd, &one, sizeof(one));
+	pthread_mutex_unlock(&s->lock);
+	return 0;
+}
+
+void libe_loop_wakeup(struct libe_loop *s)
+{
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&s->lock);
+	if (s->wakefd >= 0)
+		write(s->wakefd, &one, sizeof(one));
+	pthread_mutex_unlock(&s->lock);
 }
 
 /* cleanup storage */
-__attribute__((destructor))
-void libe_cleanup(void)
+static void e_cleanup(struct libe_loop *s)
 {
-	struct event *t;
+	struct post *post;
+	int j;
 
-	while (s.events) {
-		t = s.events;
-		s.events = t->next;
-		free(t);
+	for (j = 0; j < s->nfds; ++j) {
+		if (s->fds[j])
+			free(s->fds[j]);
 	}
-	if (s.epfd >= 0)
-		close(s.epfd);
+	if (s->fds)
+		free(s->fds);
+	s->fds = NULL;
+	s->nfds = 0;
+	if (s->evs)
+		free(s->evs);
+	s->evs = NULL;
+	s->nevs = 0;
+	if (s->epfd >= 0)
+		close(s->epfd);
+	s->epfd = -1;
+
+	pthread_mutex_lock(&s->lock);
+	if (s->wakefd >= 0)
+		close(s->wakefd);
+	s->wakefd = -1;
+	/* drop callbacks that never ran */
+	while (s->posts) {
+		post = s->posts;
+		s->posts = post->next;
+		free(post);
+	}
+	s->lastpost = &s->posts;
+	pthread_mutex_unlock(&s->lock);
+}
+
+/* loop instances */
+struct libe_loop *libe_loop_new(void)
+{
+	struct libe_loop *s;
+
+	s = malloc(sizeof(*s));
+	if (!s)
+		return NULL;
+	memset(s, 0, sizeof(*s));
+	s->epfd = -1;
+	s->maxevs = NEVS;
+	pthread_mutex_init(&s->lock, NULL);
+	s->wakefd = -1;
+	s->lastpost = &s->posts;
+	return s;
+}
+
+void libe_loop_free(struct libe_loop *s)
+{
+	if (!s || (s == &e_default))
+		return;
+	if (e_current == s)
+		e_current = NULL;
+	e_cleanup(s);
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+}
+
+void libe_set_loop(struct libe_loop *s)
+{
+	e_current = s;
+}
+
+struct libe_loop *libe_get_loop(void)
+{
+	return e_cur();
+}
+
+/* API on the loop of this thread */
+int libe_add_fd(int fd, void (*fn)(int fd, void *), const void *dat)
+{
+	return libe_loop_add_fd_flags(e_cur(), fd, 0, fn, dat);
+}
+
+int libe_add_fd_flags(int fd, int flags, void (*fn)(int fd, void *), const void *dat)
+{
+	return libe_loop_add_fd_flags(e_cur(), fd, flags, fn, dat);
+}
+
+int libe_mod_fd(int fd, int flags)
+{
+	return libe_loop_mod_fd(e_cur(), fd, flags);
+}
+
+int libe_get_flags(int fd)
+{
+	return libe_loop_get_flags(e_cur(), fd);
+}
+
+int libe_revents(void)
+{
+	return e_cur()->revents;
+}
+
+void libe_remove_fd(int fd)
+{
+	libe_loop_remove_fd(e_cur(), fd);
+}
+
+int libe_set_maxevents(int maxevents)
+{
+	return libe_loop_set_maxevents(e_cur(), maxevents);
+}
+
+int libe_wait(int waitmsec)
+{
+	return libe_loop_wait(e_cur(), waitmsec);
+}
+
+void libe_flush(void)
+{
+	libe_loop_flush(e_cur());
+}
+
+void libe_set_hook(void (*hook)(void *fn, double elapsed))
+{
+	libe_loop_set_hook(e_cur(), hook);
+}
+
+void libe_cleanup(void)
+{
+	e_cleanup(e_cur());
+}
+
+/* on exit, only the default loop is known */
+__attribute__((destructor))
+static void libe_exit(void)
+{
+	e_cleanup(&e_default);
 }
@@ -25,6 +25,32 @@ extern "C" {
 /* watch for events on <fd> */
 extern int libe_add_fd(int fd, void (*fn)(int fd, void *), const void *dat);
 
+/* flags for libe_add_fd_flags() */
+/* edge triggered: the handler is only called when new data arrives,
+ * so it must consume all data, until EAGAIN is returned.
+ */
+#define LIBE_ET		0x01
+/* events to watch, LIBE_IN is used when none is given */
+#define LIBE_IN		0x02
+#define LIBE_OUT	0x04
+#define LIBE_PRI	0x08 /* urgent data, or sysfs poll() notification */
+#define LIBE_RDHUP	0x10 /* peer closed writing */
+/* events that are always reported */
+#define LIBE_ERR	0x20
+#define LIBE_HUP	0x40
+#define LIBE_EVENTS	(LIBE_IN | LIBE_OUT | LIBE_PRI | LIBE_RDHUP)
+
+/* watch for events on <fd>, with LIBE_xxx <flags> */
+extern int libe_add_fd_flags(int fd, int flags, void (*fn)(int fd, void *), const void *dat);
+
+/* change the LIBE_xxx <flags> of a watched <fd> */
+extern int libe_mod_fd(int fd, int flags);
+/* retrieve the LIBE_xxx <flags> of a watched <fd> */
+extern int libe_get_flags(int fd);
+
+/* retrieve the LIBE_xxx events that triggered the current handler */
+extern int libe_revents(void);
+
 /* remove a watched <fd>
  * Nothing happens when no matching timeout is found
  */
@@ -33,16 +59,66 @@ extern void libe_remove_fd(int fd);
 /* wait for any fd to become active, for up to <waitmsec> milliseconds */
 extern int libe_wait(int waitmsec);
 
+/* set the max. number of events returned by 1 libe_wait()
+ * The default is 16, and doubles up to 1024 when all were used.
+ */
+extern int libe_set_maxevents(int maxevents);
+
 /* handle any queued events
  * This will call assigned handlers
  */
 extern void libe_flush(void);
 
-/* cleanup, called automatically on exit also
+/* call <hook> after each handler, with the handler and its duration
+ * in seconds, for profiling. NULL removes the hook.
+ */
+extern void libe_set_hook(void (*hook)(void *fn, double elapsed));
+
+/* cleanup the loop of the calling thread
+ * The default loop is cleaned up automatically on exit also.
  * May be called twice.
  */
 extern void libe_cleanup(void);
 
+/* event loop instances
+ * All calls above operate on the loop of the calling thread,
+ * which is the default loop unless libe_set_loop() selected another.
+ * A loop must only be used by 1 thread, except for
+ * libe_loop_post() & libe_loop_wakeup()
+ * Loops from libe_loop_new() are not cleaned up on exit,
+ * free them with libe_loop_free(), e.g. before their thread exits.
+ */
+struct libe_loop;
+
+extern struct libe_loop *libe_loop_new(void);
+/* free a loop, watched fds are not closed */
+extern void libe_loop_free(struct libe_loop *loop);
+
+/* select the loop of the calling thread, NULL selects the default loop */
+extern void libe_set_loop(struct libe_loop *loop);
+extern struct libe_loop *libe_get_loop(void);
+
+extern int libe_loop_add_fd(struct libe_loop *loop, int fd,
+		void (*fn)(int fd, void *), const void *dat);
+extern int libe_loop_add_fd_flags(struct libe_loop *loop, int fd, int flags,
+		void (*fn)(int fd, void *), const void *dat);
+extern int libe_loop_mod_fd(struct libe_loop *loop, int fd, int flags);
+extern int libe_loop_get_flags(struct libe_loop *loop, int fd);
+extern int libe_loop_revents(struct libe_loop *loop);
+extern void libe_loop_remove_fd(struct libe_loop *loop, int fd);
+extern int libe_loop_set_maxevents(struct libe_loop *loop, int maxevents);
+extern int libe_loop_wait(struct libe_loop *loop, int waitmsec);
+extern void libe_loop_flush(struct libe_loop *loop);
+extern void libe_loop_set_hook(struct libe_loop *loop,
+		void (*hook)(void *fn, double elapsed));
+
+/* thread-safe: run fn(dat) from within libe_loop_flush() of <loop>
+ * Callbacks run in the order they were posted.
+ */
+extern int libe_loop_post(struct libe_loop *loop, void (*fn)(void *), const void *dat);
+/* thread-safe: interrupt libe_loop_wait() of <loop> */
+extern void libe_loop_wakeup(struct libe_loop *loop);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,6 +17,7 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -24,55 +25,124 @@
 
 #include "libt.h"
 
+/*
+ * Scheduling backend:
+ * By default, timers are kept in a hierarchical timing wheel,
+ * which makes insert & remove O(1), and expiry amortized O(1).
+ * Define USE_TIMER_LIST to keep the simple sorted list,
+ * which is smaller for tiny builds with few timers.
+ */
+#ifndef USE_TIMER_LIST
+/* resolution of 1 wheel tick, in seconds */
+#define WHEEL_TICK	0.001
+/* 64 slots per level fit in 1 uint64_t occupancy bitmap */
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE -1)
+/* 5 levels span 2^30 ticks, or 12 days. Longer timeouts are
+ * parked in the last slot, and re-inserted when that is cascaded
+ */
+#define WHEEL_LEVELS	5
+#define WHEEL_SPAN	(1ULL << (WHEEL_BITS*WHEEL_LEVELS))
+#endif
+
+/* granularity used to align timeouts with slack */
+#define SLACK_TICK	0.001
+
+/* timers are allocated in slabs of POOL_SLAB */
+#ifndef POOL_SLAB
+#define POOL_SLAB	32
+#endif
+
 struct timer {
-	struct timer *next, *prev;
+	struct timer *next, **pprev;
 	void (*fn)(void *dat);
 	void *dat;
 	double wakeup;
+	/* requested wakeup, @wakeup may be later within @slack */
+	double base;
+	double slack;
+#ifndef USE_TIMER_LIST
+	/* index in the wheel, or -1 */
+	int slot;
+#endif
+};
+
+struct slab {
+	struct slab *next;
+	struct timer timers[POOL_SLAB];
 };
 
-static struct {
+struct libt_wheel {
+#ifdef USE_TIMER_LIST
 	struct timer *timers;
+#else
+	struct timer *wheel[WHEEL_LEVELS*WHEEL_SIZE];
+	/* occupancy bitmap per level */
+	uint64_t used[WHEEL_LEVELS];
+	/* current tick, all earlier ticks have been expired */
+	uint64_t cur;
+	int nwheel;
+	/* expired timers of 1 tick, waiting for their callback */
+	struct timer *pending;
+#endif
 	struct timer *tmptimers;
-} s;
+	/* timers this close in the future are considered expired */
+	double fudge;
+	/* lateness of fired timers */
+	struct libt_latestat late;
+	/* called after each callback */
+	void (*hook)(void *fn, double late, double elapsed);
+	/* (fn, dat) index of all timers, open addressing */
+	struct timer **index;
+	unsigned int indexsize; /* power of 2 */
+	unsigned int nindex;
+	/* timer pool, unused timers are linked via @next */
+	struct slab *slabs;
+	struct timer *freetimers;
+	struct libt_poolstat pool;
+};
 
-/* double-linked-list black magic:
- * The @prev member of the first element points to a 'fake' element
- * which is well-crafted so that assigning prev->next just happens
- * to set the root pointer
- * This function return the required 'fake' pointers
- */
-static inline struct timer *t_fakeelement(struct timer **root)
-{
-	return (struct timer *)(((char *)root) - offsetof(struct timer, next));
+/* default wheel, for the main thread */
+static struct libt_wheel t_default = {
+	.fudge = 0.001,
+};
+
+/* wheel used by the libt_xxx calls of this thread */
+static __thread struct libt_wheel *t_current;
 
+static inline struct libt_wheel *t_cur(void)
+{
+	return t_current ?: &t_default;
 }
 
-/* double linked list */
+/* double linked list
+ * @pprev points to the pointer that points to this element,
+ * being the @next member of the previous element, or the root pointer.
+ * The root pointer is thus modified via a real (struct timer **),
+ * which keeps the compiler's aliasing rules happy.
+ */
 static void t_del(struct timer *t)
 {
 	if (t->next)
-		t->next->prev = t->prev;
-	if (t->prev)
-		t->prev->next = t->next;
-	t->next = t->prev = NULL;
+		t->next->pprev = t->pprev;
+	if (t->pprev)
+		*t->pprev = t->next;
+	t->next = NULL;
+	t->pprev = NULL;
 }
 
 static void t_add(struct timer *t, struct timer **root)
 {
 	t_del(t);
 	t->next = *root;
-	if (t->next) {
-		t->prev = t->next->prev;
-		t->next->prev = t;
-	} else
-		/* this is dirty: fake a timer struct, which will only be used
-		 * for setting the @next member
-		 */
-		t->prev = t_fakeelement(root);
-	t->prev->next = t;
+	if (t->next)
+		t->next->pprev = &t->next;
+	t->pprev = root;
+	*root = t;
 }
 
+#ifdef USE_TIMER_LIST
 static void t_add_sorted(struct timer *t, struct timer **root)
 {
 	t_del(t);
@@ -84,22 +154,339 @@ static void t_add_sorted(struct timer *t, struct timer **root)
 	t_add(t, root);
 }
 
+/* scheduler backend: sorted list */
+static inline void t_unlink(struct libt_wheel *s, struct timer *t)
+{
+	t_del(t);
+}
+
+static inline void t_schedule(struct libt_wheel *s, struct timer *t)
+{
+	t_add_sorted(t, &s->timers);
+}
+
+static inline struct timer *t_first(struct libt_wheel *s)
+{
+	return s->timers;
+}
+
+static inline struct timer *t_next_expired(struct libt_wheel *s, double now)
+{
+	return (s->timers && s->timers->wakeup <= now) ? s->timers : NULL;
+}
+
+#else
+/* scheduler backend: hierarchical timing wheel */
+static inline uint64_t w_tick(double wakeup)
+{
+	return (uint64_t)(wakeup / WHEEL_TICK);
+}
+
+static void t_unlink(struct libt_wheel *s, struct timer *t)
+{
+	t_del(t);
+	if (t->slot >= 0) {
+		if (!s->wheel[t->slot])
+			s->used[t->slot >> WHEEL_BITS] &=
+				~(1ULL << (t->slot & WHEEL_MASK));
+		t->slot = -1;
+		--s->nwheel;
+	}
+}
+
+static void t_schedule(struct libt_wheel *s, struct timer *t)
+{
+	uint64_t expire, idx;
+	int lvl;
+
+	t_unlink(s, t);
+	if (!s->nwheel && !s->pending)
+		/* empty wheel, fast-forward */
+		s->cur = w_tick(libt_now());
+	expire = w_tick(t->wakeup);
+	if (expire < s->cur)
+		expire = s->cur;
+	idx = expire - s->cur;
+	if (idx >= WHEEL_SPAN) {
+		/* park far timeouts in the last slot */
+		idx = WHEEL_SPAN -1;
+		expire = s->cur + idx;
+	}
+	for (lvl = 0; idx >> (WHEEL_BITS*(lvl+1)); ++lvl);
+
+	t->slot = (lvl << WHEEL_BITS) +
+		((expire >> (WHEEL_BITS*lvl)) & WHEEL_MASK);
+	t_add(t, &s->wheel[t->slot]);
+	s->used[lvl] |= 1ULL << (t->slot & WHEEL_MASK);
+	++s->nwheel;
+}
+
+/* return the first occupied slot of @lvl, starting from @start,
+ * and put its absolute (shifted) tick in *pstart
+ */
+static int w_first_slot(struct libt_wheel *s, int lvl, uint64_t *pstart)
+{
+	uint64_t used;
+	int rot;
+
+	used = s->used[lvl];
+	if (!used)
+		return -1;
+	rot = *pstart & WHEEL_MASK;
+	if (rot)
+		used = (used >> rot) | (used << (WHEEL_SIZE - rot));
+	*pstart += __builtin_ctzll(used);
+	return (lvl << WHEEL_BITS) + (*pstart & WHEEL_MASK);
+}
+
+/* return the first tick where a slot needs attention:
+ * a slot of level 0 expires, or a higher slot must be cascaded
+ */
+static uint64_t w_next_tick(struct libt_wheel *s)
+{
+	uint64_t next = ~0ULL, start;
+	int lvl, shift;
+
+	for (lvl = 0; lvl < WHEEL_LEVELS; ++lvl) {
+		shift = WHEEL_BITS*lvl;
+		/* higher levels never hold the current window */
+		start = (s->cur >> shift) + !!lvl;
+		if (w_first_slot(s, lvl, &start) < 0)
+			continue;
+		if ((start << shift) < next)
+			next = start << shift;
+	}
+	return next;
+}
+
+/* redistribute timers of the higher slots that start at the current tick */
+static void w_cascade(struct libt_wheel *s)
+{
+	struct timer *t, *tmp = NULL;
+	int lvl, slot;
+
+	for (lvl = WHEEL_LEVELS -1; lvl > 0; --lvl) {
+		if (s->cur & ((1ULL << (WHEEL_BITS*lvl)) -1))
+			continue;
+		slot = (lvl << WHEEL_BITS) +
+			((s->cur >> (WHEEL_BITS*lvl)) & WHEEL_MASK);
+		/* detach first, parked timers may return to this slot */
+		while (s->wheel[slot]) {
+			t = s->wheel[slot];
+			t_unlink(s, t);
+			t_add(t, &tmp);
+		}
+		while (tmp)
+			t_schedule(s, tmp);
+	}
+}
+
+static struct timer *t_next_expired(struct libt_wheel *s, double now)
+{
+	uint64_t target, next;
+	struct timer *t, *tnext;
+	int slot;
+
+	target = w_tick(now);
+	while (!s->pending) {
+		slot = s->cur & WHEEL_MASK;
+		if (s->cur >= target) {
+			/* current tick: only what has passed */
+			for (t = s->wheel[slot]; t; t = tnext) {
+				tnext = t->next;
+				if (t->wakeup <= now) {
+					t_unlink(s, t);
+					t_add(t, &s->pending);
+				}
+			}
+			break;
+		}
+		/* whole tick has passed */
+		while (s->wheel[slot]) {
+			t = s->wheel[slot];
+			t_unlink(s, t);
+			t_add(t, &s->pending);
+		}
+		next = w_next_tick(s);
+		if (next > target) {
+			s->cur = target;
+		} else {
+			s->cur = next;
+			w_cascade(s);
+		}
+	}
+	return s->pending;
+}
+
+static inline struct timer *t_first(struct libt_wheel *s)
+{
+	struct timer *t, *first = NULL;
+	uint64_t start, used;
+	int lvl, slot;
+
+	for (t = s->pending; t; t = t->next) {
+		if (!first || t->wakeup < first->wakeup)
+			first = t;
+	}
+	/* the first occupied slot of each level holds its earliest timer */
+	for (lvl = 0; lvl < WHEEL_LEVELS -1; ++lvl) {
+		start = (s->cur >> (WHEEL_BITS*lvl)) + !!lvl;
+		slot = w_first_slot(s, lvl, &start);
+		if (slot < 0)
+			continue;
+		for (t = s->wheel[slot]; t; t = t->next) {
+			if (!first || t->wakeup < first->wakeup)
+				first = t;
+		}
+	}
+	/* parked timeouts may precede earlier timeouts in the last level */
+	for (used = s->used[lvl]; used; used &= used -1) {
+		slot = (lvl << WHEEL_BITS) + __builtin_ctzll(used);
+		for (t = s->wheel[slot]; t; t = t->next) {
+			if (!first || t->wakeup < first->wakeup)
+				first = t;
+		}
+	}
+	return first;
+}
+#endif
+
+/* (fn, dat) index
+ * Every allocated timer, scheduled or just fired, is in the index.
+ * Collisions are resolved with linear probing,
+ * deleting shifts the following entries back, so no tombstones exist.
+ */
+static inline unsigned int t_hash(void (*fn)(void *), const void *dat)
+{
+	uint64_t h;
+
+	h = (uintptr_t)fn ^ ((uint64_t)(uintptr_t)dat * 0x9e3779b97f4a7c15ULL);
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+static void t_index_add(struct libt_wheel *s, struct timer *t)
+{
+	struct timer **old = s->index;
+	unsigned int j, oldsize = s->indexsize;
+
+	if ((s->nindex +1)*2 > s->indexsize) {
+		/* keep the load below 1/2 */
+		s->indexsize = s->indexsize ? s->indexsize*2 : 64;
+		s->index = calloc(s->indexsize, sizeof(*s->index));
+		/* don't test s->index, see libt_add_timeout */
+		s->nindex = 0;
+		for (j = 0; j < oldsize; ++j) {
+			if (old[j])
+				t_index_add(s, old[j]);
+		}
+		free(old);
+	}
+	for (j = t_hash(t->fn, t->dat); s->index[j & (s->indexsize -1)]; ++j);
+	s->index[j & (s->indexsize -1)] = t;
+	++s->nindex;
+}
+
+static void t_index_del(struct libt_wheel *s, struct timer *t)
+{
+	unsigned int j, k, home, mask = s->indexsize -1;
+
+	for (j = t_hash(t->fn, t->dat) & mask; s->index[j] != t; j = (j+1) & mask);
+	/* shift back entries that probed past this spot */
+	for (k = (j+1) & mask; s->index[k]; k = (k+1) & mask) {
+		home = t_hash(s->index[k]->fn, s->index[k]->dat) & mask;
+		if (((k - home) & mask) >= ((k - j) & mask)) {
+			s->index[j] = s->index[k];
+			j = k;
+		}
+	}
+	s->index[j] = NULL;
+	--s->nindex;
+}
+
 /* local/private tools */
-static struct timer *t_find(void (*fn)(void *), const void *dat)
+static struct timer *t_find(struct libt_wheel *s, void (*fn)(void *), const void *dat)
 {
 	struct timer *t;
+	unsigned int j, mask = s->indexsize -1;
 
-	for (t = s.timers; t; t = t->next) {
-		if ((t->fn == fn) && (t->dat == dat))
-			return t;
-	}
-	for (t = s.tmptimers; t; t = t->next) {
+	if (!s->nindex)
+		return NULL;
+	for (j = t_hash(fn, dat) & mask; s->index[j]; j = (j+1) & mask) {
+		t = s->index[j];
 		if ((t->fn == fn) && (t->dat == dat))
 			return t;
 	}
 	return NULL;
 }
 
+/* timer pool */
+static struct timer *t_alloc(struct libt_wheel *s)
+{
+	struct slab *slab;
+	struct timer *t;
+	int j;
+
+	if (!s->freetimers) {
+		slab = malloc(sizeof(*slab));
+		/* don't test slab since I don't know what to do if it was NULL
+		 * So, I just use it, and maybe we segfault, which is the best
+		 * I can imagine in that case
+		 */
+		slab->next = s->slabs;
+		s->slabs = slab;
+		for (j = POOL_SLAB -1; j >= 0; --j) {
+			slab->timers[j].next = s->freetimers;
+			s->freetimers = &slab->timers[j];
+		}
+		++s->pool.slabs;
+		s->pool.size += POOL_SLAB;
+	}
+	t = s->freetimers;
+	s->freetimers = t->next;
+	memset(t, 0, sizeof(*t));
+
+	++s->pool.allocs;
+	if (++s->pool.used > s->pool.peak)
+		s->pool.peak = s->pool.used;
+	return t;
+}
+
+static void t_free(struct libt_wheel *s, struct timer *t)
+{
+	t_index_del(s, t);
+	t->next = s->freetimers;
+	s->freetimers = t;
+	--s->pool.used;
+}
+
+/* Choose a wakeup within [@wakeup, @wakeup + @slack] with as many
+ * trailing zero bits as possible, in SLACK_TICK units.
+ * Independent timeouts with slack tend to land on the same wakeup
+ * that way, which saves wakeups without keeping track of each other.
+ */
+static double t_apply_slack(double wakeup, double slack)
+{
+	uint64_t lo, hi;
+	int bit;
+
+	if (!(slack > 0))
+		return wakeup;
+	lo = ceil(wakeup / SLACK_TICK);
+	hi = (wakeup + slack) / SLACK_TICK;
+	if (hi <= lo)
+		return wakeup;
+	/* keep the highest differing bit of @hi, and clear all below,
+	 * unless @lo has even more trailing zeros
+	 */
+	bit = 63 - __builtin_clzll(lo ^ hi);
+	if (!lo || (__builtin_ctzll(lo) > bit))
+		return lo * SLACK_TICK;
+	return (hi & ~((1ULL << bit) -1)) * SLACK_TICK;
+}
+
 /* exported API */
 double libt_now(void)
 {
@@ -116,106 +503,135 @@ double libt_now(void)
 #endif
 }
 
-void libt_add_timeout(double timeout, void (*fn)(void *), const void *dat)
+void libt_wheel_add_timeout(struct libt_wheel *s, double timeout,
+		void (*fn)(void *), const void *dat)
+{
+	libt_wheel_add_timeout_slack(s, timeout, 0, fn, dat);
+}
+
+void libt_wheel_add_timeout_slack(struct libt_wheel *s,
+		double timeout, double slack, void (*fn)(void *), const void *dat)
 {
 	struct timer *t;
 
 	if (isnan(timeout))
 		return;
-	t = t_find(fn, dat);
+	t = t_find(s, fn, dat);
 	if (!t) {
-		t = malloc(sizeof(*t));
-		/* don't test t since I don't know what to do if it was NULL
-		 * So, I just use it, and maybe we segfault, which is the best
-		 * I can imagine in that case
-		 */
-		memset(t, 0, sizeof(*t));
+		t = t_alloc(s);
 		t->fn = fn;
 		t->dat = (void *)dat;
+#ifndef USE_TIMER_LIST
+		t->slot = -1;
+#endif
+		t_index_add(s, t);
 	}
-	t->wakeup = libt_now() + timeout;
-	t_add_sorted(t, &s.timers);
+	t->base = libt_now() + timeout;
+	t->slack = slack;
+	t->wakeup = t_apply_slack(t->base, t->slack);
+	t_schedule(s, t);
 }
 
-void libt_repeat_timeout(double increment, void (*fn)(void *), const void *dat)
+void libt_wheel_repeat_timeout(struct libt_wheel *s, double increment,
+		void (*fn)(void *), const void *dat)
 {
 	struct timer *t;
 
 	if (isnan(increment))
 		return;
-	t = t_find(fn, dat);
+	t = t_find(s, fn, dat);
 	if (!t)
-		libt_add_timeout(increment, fn, dat);
+		libt_wheel_add_timeout(s, increment, fn, dat);
 	else {
 		double now = libt_now();
 
-		t->wakeup += increment;
-		if (t->wakeup < now)
+		t->base += increment;
+		if (t->base < now)
 			/* We're scheduling in the past.
 			 * Jump to the future again,
 			 * make 'repeat' fail in maintaining strict timing
 			 * and mimic 'add' behaviour
 			 */
-			t->wakeup = now + increment;
-		t_add_sorted(t, &s.timers);
+			t->base = now + increment;
+		/* repeat from the requested time, so slack does not drift */
+		t->wakeup = t_apply_slack(t->base, t->slack);
+		t_schedule(s, t);
 	}
 }
 
-void libt_remove_timeout(void (*fn)(void *), const void *dat)
+void libt_wheel_remove_timeout(struct libt_wheel *s,
+		void (*fn)(void *), const void *dat)
 {
 	struct timer *t;
 
-	t = t_find(fn, dat);
+	t = t_find(s, fn, dat);
 	if (t) {
-		t_del(t);
-		free(t);
+		t_unlink(s, t);
+		t_free(s, t);
 	}
 }
 
-int libt_timeout_exist(void (*fn)(void *), const void *dat)
+int libt_wheel_timeout_exist(struct libt_wheel *s,
+		void (*fn)(void *), const void *dat)
 {
-	return !!t_find(fn, dat);
+	return !!t_find(s, fn, dat);
 }
 
-int libt_flush(void)
+int libt_wheel_flush(struct libt_wheel *s)
 {
 	struct timer *t;
-	double now;
+	double now, late;
 	int cnt;
 
-	now = libt_now() +0.001;
+	now = libt_now() + s->fudge;
 	cnt = 0;
-	while (s.timers) {
-		t = s.timers;
-		if (t->wakeup > now)
-			break;
+	while ((t = t_next_expired(s, now)) != NULL) {
 		/*
 		 * move tries to garbage, for possible re-arm inside
 		 * the timer callback
 		 */
-		t_add(t, &s.tmptimers);
-		t->fn(t->dat);
+		t_unlink(s, t);
+		t_add(t, &s->tmptimers);
+		/* early firing due to fudge counts negative */
+		late = libt_now() - t->wakeup;
+		++s->late.count;
+		s->late.sum += late;
+		s->late.sumsq += late*late;
+		if (late > s->late.max)
+			s->late.max = late;
+		if (s->hook) {
+			/* t may be reused by the callback */
+			void *fn = t->fn;
+			double t0 = libt_now();
+
+			t->fn(t->dat);
+			s->hook(fn, late, libt_now() - t0);
+		} else
+			t->fn(t->dat);
 		++cnt;
 	}
 	/* clean up cache */
-	while (s.tmptimers) {
-		t = s.tmptimers;
+	while (s->tmptimers) {
+		t = s->tmptimers;
 		t_del(t);
-		free(t);
+		t_free(s, t);
 	}
 	return cnt;
 }
 
-double libt_next_wakeup(void)
+double libt_wheel_next_wakeup(struct libt_wheel *s)
 {
-	return s.timers ? s.timers->wakeup : -1;
+	struct timer *t = t_first(s);
+
+	return t ? t->wakeup : -1;
 }
 
-int libt_get_waittime(void)
+int libt_wheel_get_waittime(struct libt_wheel *s)
 {
 	double tmp;
+	struct timer *t = t_first(s);
 
-	if (!s.timers)
+	if (!t)
 		return -1;
 	/* avoid integer overflows and use double
 	 * An integer overflow may result into a negative
@@ -224,7 +640,7 @@ int libt_get_waittime(void)
 	 * libt_get_waittime() for poll() runs away with the cpu
 	 * because the waittime is wrong.
 	 */
-	tmp = (s.timers->wakeup - libt_now()) * 1000;
+	tmp = (t->wakeup - libt_now()) * 1000;
 	/* compute the max result value that we want to return.
 	 * This is 1/4 of the maximum int value
 	 */
@@ -237,20 +653,147 @@ int libt_get_waittime(void)
 		return tmp;
 }
 
+void libt_wheel_get_poolstat(struct libt_wheel *s, struct libt_poolstat *stat)
+{
+	*stat = s->pool;
+}
+
+void libt_wheel_get_latestat(struct libt_wheel *s, struct libt_latestat *stat)
+{
+	*stat = s->late;
+}
+
+void libt_wheel_set_fudge(struct libt_wheel *s, double fudge)
+{
+	s->fudge = fudge;
+}
+
+void libt_wheel_set_hook(struct libt_wheel *s,
+		void (*hook)(void *fn, double late, double elapsed))
+{
+	s->hook = hook;
+}
+
+static void t_cleanup(struct libt_wheel *s)
+{
+	struct slab *slab;
+
+	/* all timers live in the slabs */
+	while (s->slabs) {
+		slab = s->slabs;
+		s->slabs = slab->next;
+		free(slab);
+	}
+	if (s->index)
+		free(s->index);
+	memset(s, 0, sizeof(*s));
+	s->fudge = 0.001;
+}
+
+/* wheel instances */
+struct libt_wheel *libt_wheel_new(void)
+{
+	struct libt_wheel *s;
+
+	s = malloc(sizeof(*s));
+	if (!s)
+		return NULL;
+	memset(s, 0, sizeof(*s));
+	s->fudge = 0.001;
+	return s;
+}
+
+void libt_wheel_free(struct libt_wheel *s)
+{
+	if (!s || (s == &t_default))
+		return;
+	if (t_current == s)
+		t_current = NULL;
+	t_cleanup(s);
+	free(s);
+}
+
+void libt_set_wheel(struct libt_wheel *s)
+{
+	t_current = s;
+}
+
+struct libt_wheel *libt_get_wheel(void)
+{
+	return t_cur();
+}
+
+/* API on the wheel of this thread */
+void libt_add_timeout(double timeout, void (*fn)(void *), const void *dat)
+{
+	libt_wheel_add_timeout_slack(t_cur(), timeout, 0, fn, dat);
+}
+
+void libt_add_timeout_slack(double timeout, double slack,
+		void (*fn)(void *), const void *dat)
+{
+	libt_wheel_add_timeout_slack(t_cur(), timeout, slack, fn, dat);
+}
+
+void libt_repeat_timeout(double increment, void (*fn)(void *), const void *dat)
+{
+	libt_wheel_repeat_timeout(t_cur(), increment, fn, dat);
+}
+
+void libt_remove_timeout(void (*fn)(void *), const void *dat)
+{
+	libt_wheel_remove_timeout(t_cur(), fn, dat);
+}
+
+int libt_timeout_exist(void (*fn)(void *), const void *dat)
+{
+	return libt_wheel_timeout_exist(t_cur(), fn, dat);
+}
+
+int libt_flush(void)
+{
+	return libt_wheel_flush(t_cur());
+}
+
+double libt_next_wakeup(void)
+{
+	return libt_wheel_next_wakeup(t_cur());
+}
+
+int libt_get_waittime(void)
+{
+	return libt_wheel_get_waittime(t_cur());
+}
+
+void libt_get_poolstat(struct libt_poolstat *stat)
+{
+	libt_wheel_get_poolstat(t_cur(), stat);
+}
+
+void libt_get_latestat(struct libt_latestat *stat)
+{
+	libt_wheel_get_latestat(t_cur(), stat);
+}
+
+void libt_set_fudge(double fudge)
+{
+	libt_wheel_set_fudge(t_cur(), fudge);
+}
+
+void libt_set_hook(void (*hook)(void *fn, double late, double elapsed))
+{
+	libt_wheel_set_hook(t_cur(), hook);
+}
+
 /* cleanup storage */
-__attribute__((destructor))
 void libt_cleanup(void)
 {
-	struct timer *t;
+	t_cleanup(t_cur());
+}
 
-	while (s.timers) {
-		t = s.timers;
-		s.timers = t->next;
-		free(t);
-	}
-	while (s.tmptimers) {
-		t = s.tmptimers;
-		s.tmptimers = t->next;
-		free(t);
-	}
+/* on exit, only the default wheel is known */
+__attribute__((destructor))
+static void libt_exit(void)
+{
+	t_cleanup(&t_default);
 }
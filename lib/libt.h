@@ -28,6 +28,14 @@ extern double libt_now(void);
 /* schedule a timeout @timerout seconds in the future */
 extern void libt_add_timeout(double timeout, void (*fn)(void *), const void *dat);
 
+/* schedule a timeout @timeout seconds in the future,
+ * but allow it to fire up to @slack seconds later.
+ * Timeouts with slack are aligned so that they share wakeups.
+ * The slack is kept for libt_repeat_timeout()
+ */
+extern void libt_add_timeout_slack(double timeout, double slack,
+		void (*fn)(void *), const void *dat);
+
 /* repeat a previously scheduled timeout, @increment seconds further
  * When no matching scheduled timeout is found, this is identical to
  * libt_add_timeout()
@@ -56,11 +64,84 @@ extern double libt_next_wakeup(void);
  */
 extern int libt_get_waittime(void);
 
-/* cleanup, called automatically on exit also
+/* timer pool usage */
+struct libt_poolstat {
+	unsigned int slabs; /* slabs taken from the heap */
+	unsigned int size; /* timers in all slabs */
+	unsigned int used; /* timers currently in use */
+	unsigned int peak; /* maximum timers in use */
+	unsigned long allocs; /* timers handed out by the pool */
+};
+
+extern void libt_get_poolstat(struct libt_poolstat *stat);
+
+/* lateness of fired timeouts, in seconds
+ * jitter is sqrt(sumsq/count - (sum/count)^2)
+ */
+struct libt_latestat {
+	unsigned long count;
+	double sum;
+	double sumsq;
+	double max;
+};
+
+extern void libt_get_latestat(struct libt_latestat *stat);
+
+/* libt_flush() treats timeouts less than @fudge seconds in the future
+ * as expired, to compensate for the msec resolution of
+ * libt_get_waittime(). The default is 0.001.
+ * Set 0 when waiting on the exact libt_next_wakeup(), like with a timerfd.
+ */
+extern void libt_set_fudge(double fudge);
+
+/* call <hook> after each timeout callback, with the callback,
+ * its lateness and its duration in seconds, for profiling.
+ * NULL removes the hook.
+ */
+extern void libt_set_hook(void (*hook)(void *fn, double late, double elapsed));
+
+/* cleanup the wheel of the calling thread
+ * The default wheel is cleaned up automatically on exit also.
  * May be called twice.
  */
 extern void libt_cleanup(void);
 
+/* timing wheel instances
+ * All calls above operate on the wheel of the calling thread,
+ * which is the default wheel unless libt_set_wheel() selected another.
+ * A wheel must only be used by 1 thread at a time.
+ * Wheels from libt_wheel_new() are not cleaned up on exit,
+ * free them with libt_wheel_free(), e.g. before their thread exits.
+ */
+struct libt_wheel;
+
+extern struct libt_wheel *libt_wheel_new(void);
+/* free a wheel, scheduled timeouts are dropped */
+extern void libt_wheel_free(struct libt_wheel *w);
+
+/* select the wheel of the calling thread, NULL selects the default wheel */
+extern void libt_set_wheel(struct libt_wheel *w);
+extern struct libt_wheel *libt_get_wheel(void);
+
+extern void libt_wheel_add_timeout(struct libt_wheel *w, double timeout,
+		void (*fn)(void *), const void *dat);
+extern void libt_wheel_add_timeout_slack(struct libt_wheel *w,
+		double timeout, double slack, void (*fn)(void *), const void *dat);
+extern void libt_wheel_repeat_timeout(struct libt_wheel *w, double increment,
+		void (*fn)(void *), const void *dat);
+extern void libt_wheel_remove_timeout(struct libt_wheel *w,
+		void (*fn)(void *), const void *dat);
+extern int libt_wheel_timeout_exist(struct libt_wheel *w,
+		void (*fn)(void *), const void *dat);
+extern int libt_wheel_flush(struct libt_wheel *w);
+extern double libt_wheel_next_wakeup(struct libt_wheel *w);
+extern int libt_wheel_get_waittime(struct libt_wheel *w);
+extern void libt_wheel_get_poolstat(struct libt_wheel *w, struct libt_poolstat *stat);
+extern void libt_wheel_get_latestat(struct libt_wheel *w, struct libt_latestat *stat);
+extern void libt_wheel_set_fudge(struct libt_wheel *w, double fudge);
+extern void libt_wheel_set_hook(struct libt_wheel *w,
+		void (*hook)(void *fn, double late, double elapsed));
+
 #ifdef __cplusplus
 }
 #endif
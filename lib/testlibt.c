@@ -18,11 +18,39 @@
  */
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
+#include <time.h>
 
 #include <poll.h>
 
-#include "libt.h"
+/* test libt against a fake clock, so the wheel levels of days
+ * run in a fraction of a second.
+ * Build with USE_TIMER_LIST to run the same checks on the sorted list
+ */
+static int faketime;
+static double fakenow;
+
+static int test_gettime(clockid_t clk, struct timespec *ts)
+{
+	if (!faketime)
+		return clock_gettime(clk, ts);
+	ts->tv_sec = fakenow;
+	ts->tv_nsec = (fakenow - ts->tv_sec) * 1e9;
+	return 0;
+}
+
+#define clock_gettime test_gettime
+#include "libt.c"
+#undef clock_gettime
+
+/* timeouts are spread over 1ms up to 12 days,
+ * the spans of the wheel levels
+ */
+#define SPAN_TICK	0.001
+#define SPAN_LEVELS	5
+#define SPAN_LEVEL(k)	(SPAN_TICK * (1ULL << (6*(k))))
 
 double tref;
 int repeat, add;
@@ -64,12 +92,216 @@ static void test(int index, ...)
 			break;
 		poll(NULL, 0, libt_get_waittime());
 		printf("%.3lf: wakeup\n", libt_now() - tref);
-		libt_handle_expired_timers();
+		libt_flush();
 	}
 	printf("%.3lf: test done\n", libt_now() - tref);
 }
 
-int main(int argc, char *argv[])
+/* automated checks: every timeout fires once,
+ * not before its wakeup and in the first flush after its wakeup
+ */
+#define NCHK	4096
+static struct chk {
+	double wakeup;
+	/* window of timeouts with slack */
+	double base, slack;
+	/* times to re-arm with libt_repeat_timeout() */
+	int repeat, nrepeat;
+	double period;
+	int fired;
+	int pending;
+} chk[NCHK];
+static int nchk, npending, nfires, nfailed;
+static double chkfudge;
+
+#define check(cond, fmt, ...) \
+	do { \
+		if (!(cond)) { \
+			if (++nfailed < 20) \
+				printf("FAIL %s:%i: " fmt "\n", __func__, __LINE__, ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+/* the wakeup within [base, base+slack] with the most trailing zero
+ * SLACK_TICK bits, searched bit by bit
+ */
+static double slack_wakeup(double base, double slack)
+{
+	uint64_t lo, hi, k;
+	int bit;
+
+	lo = ceil(base / SLACK_TICK);
+	hi = (base + slack) / SLACK_TICK;
+	if (!(slack > 0) || (hi <= lo))
+		return base;
+	for (bit = 62; bit > 0; --bit) {
+		/* first multiple of 2^bit from lo */
+		k = ((lo + (1ULL << bit) -1) >> bit) << bit;
+		if (k <= hi)
+			return k * SLACK_TICK;
+	}
+	return lo * SLACK_TICK;
+}
+
+static void chk_fired(void *dat)
+{
+	struct chk *c = dat;
+
+	check(c->pending, "timeout %li fired twice",
+			(long)(c - chk));
+	check(c->wakeup <= libt_now() + chkfudge, "timeout %li %.3lfs early",
+			(long)(c - chk), c->wakeup - libt_now());
+	check(c->wakeup >= c->base && c->wakeup <= c->base + c->slack,
+			"timeout %li outside slack", (long)(c - chk));
+	++c->fired;
+	if (c->repeat) {
+		--c->repeat;
+		c->base += c->period;
+		c->wakeup = slack_wakeup(c->base, c->slack);
+		libt_repeat_timeout(c->period, chk_fired, c);
+	} else {
+		c->pending = 0;
+		--npending;
+	}
+}
+
+static void chk_add_repeat(double timeout, double slack,
+		int repeat, double period)
+{
+	struct chk *c = &chk[nchk++];
+
+	c->repeat = c->nrepeat = repeat;
+	c->period = period;
+	c->base = libt_now() + timeout;
+	c->slack = slack;
+	c->wakeup = slack_wakeup(c->base, slack);
+	c->pending = 1;
+	++npending;
+	nfires += 1 + repeat;
+	libt_add_timeout_slack(timeout, slack, chk_fired, c);
+}
+
+static void chk_add(double timeout, double slack)
+{
+	chk_add_repeat(timeout, slack, 0, 0);
+}
+
+/* run the clock from wakeup to wakeup */
+static void chk_run(void)
+{
+	double next, first;
+	int j, nsteps = 0;
+
+	while ((next = libt_next_wakeup()) >= 0) {
+		if (++nsteps > 2*nfires + 64) {
+			check(0, "%i steps", nsteps);
+			break;
+		}
+		for (first = INFINITY, j = 0; j < nchk; ++j) {
+			if (chk[j].pending && chk[j].wakeup < first)
+				first = chk[j].wakeup;
+		}
+		check(next == first, "next wakeup %.3lf, first timeout %.3lf",
+				next, first);
+		/* a flush in between fires nothing */
+		if (next - chkfudge > fakenow + SLACK_TICK) {
+			fakenow += (next - chkfudge - fakenow) * (rand() % 1000) / 1000;
+			check(!libt_flush(), "fired %.3lfs before %.3lf",
+					next - fakenow, next);
+		}
+		if (next > fakenow)
+			fakenow = next;
+		/* the clock has nsec resolution */
+		while (libt_now() < next)
+			fakenow += 1e-9;
+		libt_flush();
+		for (j = 0; j < nchk; ++j) {
+			check(!chk[j].pending || chk[j].wakeup > libt_now() + chkfudge,
+					"timeout %i late", j);
+		}
+	}
+	check(!npending, "%i timeouts never fired", npending);
+	for (j = 0; j < nchk; ++j) {
+		check(chk[j].fired == 1 + chk[j].nrepeat,
+				"timeout %i fired %i times", j, chk[j].fired);
+		check(!libt_timeout_exist(chk_fired, &chk[j]),
+				"timeout %i still scheduled", j);
+	}
+}
+
+static void test_wheel(double start, double fudge)
+{
+	double level, t;
+	int j, k, d;
+
+	faketime = 1;
+	fakenow = start;
+	chkfudge = fudge;
+	libt_set_fudge(fudge);
+	memset(chk, 0, sizeof(chk));
+	nchk = npending = nfires = 0;
+	srand(start);
+
+	/* around the span of each level, and beyond the last level */
+	for (k = 0; k <= SPAN_LEVELS; ++k) {
+		level = SPAN_LEVEL(k);
+		for (d = -2; d <= 2; ++d) {
+			chk_add(level + d*SPAN_TICK, 0);
+			chk_add(level + d*SPAN_TICK + SPAN_TICK/2, 0);
+		}
+#ifndef USE_TIMER_LIST
+		/* absolute cascade boundaries of this level */
+		for (d = -1; d <= 1; ++d)
+			chk_add(ceil(fakenow / level + 1) * level +
+					d*WHEEL_TICK - fakenow, 0);
+#endif
+	}
+	chk_add(0, 0);
+#ifndef USE_TIMER_LIST
+	/* parked beyond the wheel span */
+	chk_add(3*WHEEL_SPAN*WHEEL_TICK, 0);
+#endif
+	/* random timeouts, slack, and repeats on every level */
+	for (j = 0; j < 1024; ++j) {
+		k = rand() % (SPAN_LEVELS+1);
+		t = SPAN_LEVEL(k) * (rand() % 1000) / 100;
+		chk_add(t, 0);
+		if (j % 4 == 0)
+			chk_add(t, t * (rand() % 100) / 100);
+		if (j % 16 == 0)
+			chk_add_repeat(t, 0, 5, t / 3 + SPAN_TICK);
+	}
+	chk_run();
+	faketime = 0;
+	libt_set_fudge(0.001);
+}
+
+static void test_slack(void)
+{
+	double start, wakeup;
+	int j, nwakeups = 0;
+
+	/* timeouts with overlapping slack share their wakeup */
+	faketime = 1;
+	fakenow = start = 1000.0003;
+	memset(chk, 0, sizeof(chk));
+	nchk = npending = nfires = 0;
+	chkfudge = 0;
+	libt_set_fudge(0);
+	for (j = 0; j < 100; ++j)
+		chk_add(1 + j*0.001, 0.5);
+	for (wakeup = -1, j = 0; j < nchk; ++j) {
+		if (chk[j].wakeup != wakeup)
+			++nwakeups;
+		wakeup = chk[j].wakeup;
+	}
+	check(nwakeups == 1, "%i wakeups", nwakeups);
+	chk_run();
+	faketime = 0;
+	libt_set_fudge(0.001);
+}
+
+static void demo(void)
 {
 	repeat = 3;
 	test(1, 1.00, 0.75, 0.50, NAN);
@@ -79,6 +311,24 @@ int main(int argc, char *argv[])
 
 	add = 3;
 	test(3, 0.50, 1.00, 0.75, NAN);
+}
+
+int main(int argc, char *argv[])
+{
+	if ((argc > 1) && !strcmp(argv[1], "demo")) {
+		demo();
+		return 0;
+	}
+	/* start just before a boundary of all levels, and off boundaries */
+	test_wheel(SPAN_LEVEL(SPAN_LEVELS) * 3 - 0.0005, 0);
+	test_wheel(1234.5678, 0);
+	test_wheel(98765.4321, 0.001);
+	test_slack();
+	if (nfailed) {
+		printf("%i checks failed\n", nfailed);
+		return 1;
+	}
+	printf("all tests passed\n");
 	return 0;
 }
 
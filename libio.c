@@ -1,23 +1,100 @@
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <math.h>
 
+#include <unistd.h>
 #include <glob.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
 
 #include "lib/libt.h"
 #include "lib/libe.h"
 #include "_libio.h"
 
+/* high resolution mode: a timerfd wakes up for the exact next timeout */
+static int hires_fd = -1;
+static double hires_armed = NAN;
+
+static void hires_expired(int fd, void *dat)
+{
+	uint64_t cnt;
+
+	if (read(fd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+		elog(LOG_ERR, errno, "read timerfd");
+	/* timerfd is disarmed now */
+	hires_armed = NAN;
+}
+
+static int hires_waittime(void)
+{
+	struct itimerspec it = {};
+	double wakeup;
+
+	wakeup = libt_next_wakeup();
+	if (wakeup == hires_armed)
+		return -1;
+	if (wakeup >= 0) {
+		it.it_value.tv_sec = wakeup;
+		it.it_value.tv_nsec = (wakeup - it.it_value.tv_sec) * 1e9;
+		if (!it.it_value.tv_sec && !it.it_value.tv_nsec)
+			/* 0 would disarm */
+			it.it_value.tv_nsec = 1;
+	}
+	if (timerfd_settime(hires_fd, TFD_TIMER_ABSTIME, &it, NULL) < 0) {
+		elog(LOG_WARNING, errno, "timerfd_settime");
+		/* fall back to msec timing for this round */
+		hires_armed = NAN;
+		return libt_get_waittime();
+	}
+	hires_armed = wakeup;
+	return -1;
+}
+
+int libio_set_hires(int enable)
+{
+	if (enable && hires_fd < 0) {
+		hires_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (hires_fd < 0) {
+			elog(LOG_WARNING, errno, "timerfd_create");
+			return -1;
+		}
+		/* 1 read drains the timerfd, so edge triggering is safe */
+		libe_add_fd_flags(hires_fd, LIBE_ET, hires_expired, NULL);
+		/* the timerfd does not wake up early */
+		libt_set_fudge(0);
+	} else if (!enable && hires_fd >= 0) {
+		libe_remove_fd(hires_fd);
+		close(hires_fd);
+		hires_fd = -1;
+		hires_armed = NAN;
+		libt_set_fudge(0.001);
+	}
+	return 0;
+}
+
+/* wakeups of libio_wait(), for caching jitget values */
+static unsigned long cycle = 1;
+
+unsigned long libio_cycle(void)
+{
+	return cycle;
+}
+
 int libio_wait(void)
 {
 	int ret;
 
+	loopstat_mark(LIBIO_PH_APP);
 	libio_flush();
-	ret = libe_wait(libt_get_waittime());
+	loopstat_mark(LIBIO_PH_FLUSH);
+	ret = libe_wait((hires_fd >= 0) ? hires_waittime() : libt_get_waittime());
+	++cycle;
+	loopstat_mark(LIBIO_PH_WAIT);
+	loopstat_events(ret);
 	if (ret < 0) {
 		if (errno != EINTR) {
 			elog(LOG_ERR, errno, "libio_wait");
@@ -27,8 +104,11 @@ int libio_wait(void)
 		ret = 0;
 	} else
 		libe_flush();
+	loopstat_mark(LIBIO_PH_EVENTS);
 	libt_flush();
+	loopstat_mark(LIBIO_PH_TIMERS);
 	libio_run_notifiers();
+	loopstat_mark(LIBIO_PH_NOTIFIERS);
 	return ret;
 }
 
@@ -223,6 +303,138 @@ int schedule_itimer(double v)
 	return ret;
 }
 
+/* string index
+ * Maps (owner, key) to an object. Keys are copied in the entry.
+ * Equal keys may be added more than once, the last one added is found first.
+ */
+struct strentry {
+	struct strentry *next;
+	const void *owner;
+	unsigned int hash;
+	void *dat;
+	char key[1];
+};
+
+static struct {
+	struct strentry **buckets;
+	int nbuckets, nentries;
+} strindex;
+
+__attribute__((destructor))
+static void free_strindex(void)
+{
+	struct strentry *ent;
+	int j;
+
+	for (j = 0; j < strindex.nbuckets; ++j) {
+		while (strindex.buckets[j]) {
+			ent = strindex.buckets[j];
+			strindex.buckets[j] = ent->next;
+			free(ent);
+		}
+	}
+	if (strindex.buckets)
+		free(strindex.buckets);
+	/* other destructors may still delete entries */
+	strindex.buckets = NULL;
+	strindex.nbuckets = strindex.nentries = 0;
+}
+
+static unsigned int strhash(const void *owner, const char *key)
+{
+	/* FNV-1a, seeded with the owner */
+	unsigned int hash = 2166136261u ^ (unsigned int)((uintptr_t)owner >> 4);
+
+	for (; *key; ++key)
+		hash = (hash ^ (unsigned char)*key) * 16777619u;
+	return hash;
+}
+
+static void strindex_grow(void)
+{
+	struct strentry **buckets, *ent;
+	int j, nbuckets;
+
+	nbuckets = strindex.nbuckets ? strindex.nbuckets*2 : 64;
+	buckets = zalloc(sizeof(*buckets)*nbuckets);
+	for (j = 0; j < strindex.nbuckets; ++j) {
+		/* rebuild from the tail, to keep the order of equal keys */
+		struct strentry *rev = NULL;
+
+		while (strindex.buckets[j]) {
+			ent = strindex.buckets[j];
+			strindex.buckets[j] = ent->next;
+			ent->next = rev;
+			rev = ent;
+		}
+		while (rev) {
+			ent = rev;
+			rev = ent->next;
+			ent->next = buckets[ent->hash & (nbuckets -1)];
+			buckets[ent->hash & (nbuckets -1)] = ent;
+		}
+	}
+	if (strindex.buckets)
+		free(strindex.buckets);
+	strindex.buckets = buckets;
+	strindex.nbuckets = nbuckets;
+}
+
+void libio_index_add(const void *owner, const char *key, void *dat)
+{
+	struct strentry *ent, **pent;
+
+	if (strindex.nentries >= strindex.nbuckets)
+		strindex_grow();
+	ent = zalloc(sizeof(*ent) + strlen(key));
+	strcpy(ent->key, key);
+	ent->owner = owner;
+	ent->hash = strhash(owner, key);
+	ent->dat = dat;
+	pent = &strindex.buckets[ent->hash & (strindex.nbuckets -1)];
+	ent->next = *pent;
+	*pent = ent;
+	++strindex.nentries;
+}
+
+void *libio_index_find(const void *owner, const char *key)
+{
+	struct strentry *ent;
+	unsigned int hash;
+
+	if (!strindex.nbuckets)
+		return NULL;
+	hash = strhash(owner, key);
+	for (ent = strindex.buckets[hash & (strindex.nbuckets -1)]; ent;
+			ent = ent->next) {
+		if (ent->hash == hash && ent->owner == owner &&
+				!strcmp(ent->key, key))
+			return ent->dat;
+	}
+	return NULL;
+}
+
+void libio_index_del(const void *owner, const char *key, void *dat)
+{
+	struct strentry *ent, **pent;
+	unsigned int hash;
+
+	if (!strindex.nbuckets)
+		return;
+	hash = strhash(owner, key);
+	for (pent = &strindex.buckets[hash & (strindex.nbuckets -1)]; *pent;
+			pent = &(*pent)->next) {
+		ent = *pent;
+		if (ent->hash == hash && ent->owner == owner &&
+				ent->dat == dat && !strcmp(ent->key, key)) {
+			*pent = ent->next;
+			free(ent);
+			--strindex.nentries;
+			return;
+		}
+	}
+}
+
 /* iopars */
 static const struct {
 	const char *prefix;
@@ -251,6 +463,8 @@ static const struct {
 	{ "udp4", mknetioudp4, },
 	{ "udp6", mknetioudp6, },
 	{ "udp", mknetioudp4, },
+
+	{ "expr", mkexpr, },
 	{ },
 };
 
@@ -262,21 +476,115 @@ void libio_set_trace(int value)
 	libio_trace = value;
 }
 
-/* tables */
-static struct iopar **table;
-static int tablesize, tablespot = 1;
+/* tables
+ * An id holds the table slot in the low bits, and the generation
+ * of the slot above. The generation increments when the slot is freed,
+ * so a stale id does not resolve to the next iopar in the same slot.
+ * A slot whose generation runs out is retired, it never returns
+ * to the freelist.
+ * Slot 0 is never used, so valid ids are > 0.
+ */
+#define ID_SLOTBITS	20
+#define ID_MAXSLOTS	(1 << ID_SLOTBITS)
+#define ID_GENMASK	0x7ff /* keep ids positive */
+#define ID_SLOT(id)	((id) & (ID_MAXSLOTS -1))
+#define ID_MKID(gen, slot)	((((gen) & ID_GENMASK) << ID_SLOTBITS) | (slot))
+
+static struct slot {
+	struct iopar *iopar;
+	int gen;
+	/* next free slot, while free */
+	int nextfree;
+	/* 1 + index in txn.sets, when staged in the current transaction */
+	int staged;
+	/* index in dirtyids, while dirty */
+	int dirtyidx;
+	/* the current change has been notified */
+	int notified;
+} *table;
+static int tablesize, freeslot;
+/* ids of dirty iopars, in order of becoming dirty
+ * Destroyed iopars leave a 0 id behind.
+ */
+static int *dirtyids;
+static int ndirty, dirtysize;
+/* dirtyids up to here have been notified */
+static int nnotified;
+/* inside notify_dirty(), at dirtyids[notifyidx] */
+static int notifying, notifyidx;
+
+/* packed copy of value & state, indexed by slot, for bulk readers
+ * It is built on the first get_iopars(), and then repacked where
+ * values change: set_iopar(), iopar_set_dirty() and jitget refreshes.
+ */
+static struct {
+	double *values;
+	int *states;
+		/* state bits beyond the ST_xxx bits */
+		#define PK_JITGET	0x200 /* value is only valid after jitget */
+	/* id in the slot, 0 when free */
+	int *ids;
+	int size;
+} packed;
 
 __attribute__((destructor))
 static void free_table(void)
 {
 	if (table)
 		free(table);
+	if (dirtyids)
+		free(dirtyids);
+	if (packed.values)
+		free(packed.values);
+	if (packed.states)
+		free(packed.states);
+	if (packed.ids)
+		free(packed.ids);
+}
+
+void libio_pack_iopar(struct iopar *iopar)
+{
+	int slot = ID_SLOT(iopar->id);
+
+	if (!packed.size || !iopar->id)
+		/* not in use, or not registered yet */
+		return;
+	packed.values[slot] = iopar->value;
+	packed.states[slot] = iopar->state |
+		(iopar->jitget ? PK_JITGET : 0);
+	packed.ids[slot] = iopar->id;
+}
+
+static void pack_table(void)
+{
+	int j, oldsize = packed.size;
+
+	if (!tablesize || (packed.size == tablesize))
+		return;
+	packed.values = realloc(packed.values, sizeof(*packed.values)*tablesize);
+	packed.states = realloc(packed.states, sizeof(*packed.states)*tablesize);
+	packed.ids = realloc(packed.ids, sizeof(*packed.ids)*tablesize);
+	if (!packed.values || !packed.states || !packed.ids)
+		elog(LOG_CRIT, errno, "realloc");
+	packed.size = tablesize;
+	for (j = oldsize; j < tablesize; ++j) {
+		packed.states[j] = 0;
+		packed.values[j] = NAN;
+		packed.ids[j] = 0;
+		if (table[j].iopar)
+			libio_pack_iopar(table[j].iopar);
+	}
 }
 
 static inline struct iopar *_lookup_iopar(int iopar_id)
 {
-	return ((iopar_id >= 0) && (iopar_id < tablesize)) ?
-		table[iopar_id] : NULL;
+	struct iopar *iopar;
+
+	if ((iopar_id <= 0) || (ID_SLOT(iopar_id) >= tablesize))
+		return NULL;
+	iopar = table[ID_SLOT(iopar_id)].iopar;
+	/* stale ids have an old generation */
+	return (iopar && (iopar->id == iopar_id)) ? iopar : NULL;
 }
 
 struct iopar *lookup_iopar(int iopar_id)
@@ -284,24 +592,59 @@ struct iopar *lookup_iopar(int iopar_id)
 	return _lookup_iopar(iopar_id);
 }
 
-static void add_iopar(struct iopar *iopar)
+static void grow_table(void)
 {
-	int oldtablesize = tablesize;
+	int j, oldtablesize = tablesize;
 
-	for (; tablespot < tablesize; ++tablespot) {
-		if (!table[tablespot])
-			goto empty_spot;
-	}
-	tablesize += 16;
+	tablesize = tablesize ? tablesize*2 : 16;
+	if (tablesize > ID_MAXSLOTS)
+		elog(LOG_CRIT, 0, "more than %i iopars", ID_MAXSLOTS -1);
 	table = realloc(table, sizeof(*table)*tablesize);
 	if (!table)
 		elog(LOG_CRIT, errno, "realloc");
 	memset(table + oldtablesize, 0,
 			sizeof(*table)*(tablesize - oldtablesize));
-empty_spot:
-	iopar->id = tablespot;
-	table[tablespot] = iopar;
-	++tablespot;
+	/* add new slots to the freelist, lowest first, skip slot 0 */
+	for (j = tablesize -1; j >= oldtablesize && j > 0; --j) {
+		table[j].nextfree = freeslot;
+		freeslot = j;
+	}
+}
+
+static void add_iopar(struct iopar *iopar)
+{
+	int slot;
+
+	if (!freeslot)
+		grow_table();
+	slot = freeslot;
+	freeslot = table[slot].nextfree;
+	iopar->id = ID_MKID(table[slot].gen, slot);
+	table[slot].iopar = iopar;
+	table[slot].notified = 0;
+	if (packed.size) {
+		pack_table();
+		libio_pack_iopar(iopar);
+	}
+	if (iopar->state & ST_DIRTY)
+		/* became dirty during construction */
+		libio_push_dirty(iopar);
+}
+
+void libio_push_dirty(struct iopar *iopar)
+{
+	if (!iopar->id)
+		/* not registered yet, add_iopar() will push it */
+		return;
+	if (ndirty >= dirtysize) {
+		dirtysize = dirtysize ? dirtysize*2 : 16;
+		dirtyids = realloc(dirtyids, sizeof(*dirtyids)*dirtysize);
+		if (!dirtyids)
+			elog(LOG_CRIT, errno, "realloc");
+	}
+	table[ID_SLOT(iopar->id)].dirtyidx = ndirty;
+	dirtyids[ndirty++] = iopar->id;
+	libio_pack_iopar(iopar);
 }
 
 struct iopar *create_libiopar(const char *str)
@@ -337,8 +680,10 @@ int create_iopar(const char *str)
 		return -1;
 	iopar = create_libiopar(str);
 	if (iopar) {
-		iopar->name = strdup(str);
+		iopar->name = iopar_strdup(str);
 		add_iopar(iopar);
+		arena_add_iopar(iopar->id);
+		libio_index_add(&table, iopar->name, iopar);
 		return iopar->id;
 	}
 	elog(LOG_NOTICE, 0, "%s %s failed", __func__, str);
@@ -364,13 +709,14 @@ int create_ioparf(const char *fmt, ...)
 void cleanup_libiopar(struct iopar *iopar)
 {
 	if (iopar->name)
-		free(iopar->name);
+		iopar_free(iopar->name);
 }
 
 void destroy_iopar(int iopar_id)
 {
 	struct iopar *iopar = _lookup_iopar(iopar_id);
 	struct iopar_notifier *notifier;
+	int slot;
 
 	if (!iopar)
 		return;
@@ -380,6 +726,16 @@ void destroy_iopar(int iopar_id)
 		iopar->notifiers = iopar->notifiers->next;
 		free(notifier);
 	}
+	if (iopar->name)
+		libio_index_del(&table, iopar->name, iopar);
+	if (iopar->state & ST_DIRTY) {
+		int j;
+
+		for (j = 0; j < ndirty; ++j) {
+			if (dirtyids[j] == iopar_id)
+				dirtyids[j] = 0;
+		}
+	}
 	/* iopar_id has proven valid here */
 	if (iopar->del)
 		iopar->del(iopar);
@@ -387,30 +743,138 @@ void destroy_iopar(int iopar_id)
 		/* default cleanup: we cannot do anything else here */
 		cleanup_libiopar(iopar);
 
-	table[iopar_id] = NULL;
-	if (iopar_id < tablespot)
-		tablespot = iopar_id;
+	slot = ID_SLOT(iopar_id);
+	table[slot].iopar = NULL;
+	/* invalidate the old id */
+	if (++table[slot].gen <= ID_GENMASK) {
+		table[slot].nextfree = freeslot;
+		freeslot = slot;
+	}
+	if (packed.size) {
+		packed.states[slot] = 0;
+		packed.values[slot] = NAN;
+		packed.ids[slot] = 0;
+	}
+}
+
+/* transactions: staged sets, applied by libio_commit() */
+static struct {
+	int depth;
+	struct staged {
+		int id;
+		double value;
+	} *sets;
+	int nsets, size;
+} txn;
+
+__attribute__((destructor))
+static void free_txn(void)
+{
+	if (txn.sets)
+		free(txn.sets);
+}
+
+static struct staged *txn_find(int iopar_id)
+{
+	int slot = ID_SLOT(iopar_id), staged;
+
+	if ((iopar_id <= 0) || (slot >= tablesize))
+		return NULL;
+	/* markers of earlier transactions don't match anymore */
+	staged = table[slot].staged;
+	if (!staged || (staged > txn.nsets) ||
+			(txn.sets[staged-1].id != iopar_id))
+		return NULL;
+	return &txn.sets[staged-1];
+}
+
+static int txn_stage(int iopar_id, double value)
+{
+	struct staged *st;
+
+	st = txn_find(iopar_id);
+	if (!st) {
+		if (txn.nsets >= txn.size) {
+			txn.size = txn.size ? txn.size*2 : 16;
+			txn.sets = realloc(txn.sets, sizeof(*txn.sets)*txn.size);
+			if (!txn.sets)
+				elog(LOG_CRIT, errno, "realloc");
+		}
+		st = &txn.sets[txn.nsets++];
+		st->id = iopar_id;
+		table[ID_SLOT(iopar_id)].staged = txn.nsets;
+	}
+	/* last write wins */
+	st->value = value;
+	return 0;
+}
+
+static int _set_iopar(struct iopar *iopar, double value)
+{
+	int ret;
+	double saved_value;
+
+	saved_value = iopar->value;
+	ret = iopar->set(iopar, value);
+	/* forget the cached jitget value */
+	iopar->jitcycle = 0;
+	if ((ret >= 0) && (iopar->value != saved_value))
+		iopar_set_dirty(iopar);
+	libio_pack_iopar(iopar);
+	return ret;
 }
 
 /* iopar use */
+/* test if the last jitget value may be reused */
+static inline int jit_fresh(struct iopar *iopar)
+{
+	if (!iopar->jitcycle)
+		return 0;
+	if (iopar->maxage < 0)
+		/* IOPAR_MAXAGE_CYCLE */
+		return iopar->jitcycle == cycle;
+	return (libt_now() - iopar->jittime) < iopar->maxage;
+}
+
 double get_iopar(int iopar_id)
 {
 	struct iopar *iopar = _lookup_iopar(iopar_id);
+	struct staged *st;
 
 	if (!iopar) {
 		errno = ENODEV;
 		return NAN;
 	}
-	if (iopar->jitget)
+	if (txn.nsets && (st = txn_find(iopar_id)) != NULL)
+		/* read back what this transaction wrote */
+		return st->value;
+	if (iopar->jitget && !jit_fresh(iopar)) {
 		iopar->jitget(iopar);
+		if (iopar->maxage) {
+			iopar->jitcycle = cycle;
+			iopar->jittime = (iopar->maxage > 0) ? libt_now() : 0;
+		}
+		libio_pack_iopar(iopar);
+	}
 	return iopar->value;
 }
 
+int iopar_set_maxage(int iopar_id, double maxage)
+{
+	struct iopar *iopar = _lookup_iopar(iopar_id);
+
+	if (!iopar) {
+		errno = ENODEV;
+		return -1;
+	}
+	iopar->maxage = maxage;
+	iopar->jitcycle = 0;
+	return 0;
+}
+
 int set_iopar(int iopar_id, double value)
 {
 	struct iopar *iopar = _lookup_iopar(iopar_id);
-	int ret;
-	double saved_value;
 
 	if (!iopar) {
 		errno = ENODEV;
@@ -420,14 +884,80 @@ int set_iopar(int iopar_id, double value)
 		errno = ENOTSUP;
 		return -1;
 	}
+	if (txn.depth)
+		return txn_stage(iopar_id, value);
+	return _set_iopar(iopar, value);
+}
 
-	saved_value = iopar->value;
-	ret = iopar->set(iopar, value);
-	if ((ret >= 0) && (iopar->value != saved_value))
-		iopar->state |= ST_DIRTY;
+int get_iopars(const int *ids, double *values, int n)
+{
+	return get_iopar_v(ids, values, n, NULL);
+}
+
+int get_iopar_v(const int *ids, double *values, int n, const unsigned long *mask)
+{
+	int j, id, slot, ret = 0;
+
+	if (!packed.size)
+		pack_table();
+	for (j = 0; j < n; ++j) {
+		if (mask && !iopar_mask_test(mask, j))
+			continue;
+		id = ids[j];
+		slot = ID_SLOT(id);
+		if ((id <= 0) || (slot >= packed.size) ||
+				(packed.ids[slot] != id)) {
+			values[j] = NAN;
+			errno = ENODEV;
+			ret = -1;
+		} else if ((packed.states[slot] & PK_JITGET) || txn.nsets)
+			values[j] = get_iopar(id);
+		else
+			values[j] = packed.values[slot];
+	}
+	return ret;
+}
+
+int set_iopar_v(const int *ids, const double *values, int n)
+{
+	int j, ret = 0;
+
+	for (j = 0; j < n; ++j) {
+		if (set_iopar(ids[j], values[j]) < 0)
+			ret = -1;
+	}
 	return ret;
 }
 
+int iopar_dirty_mask(const int *ids, int n, unsigned long *mask)
+{
+	int j, id, slot, cnt = 0;
+	struct iopar *iopar;
+
+	memset(mask, 0, sizeof(*mask)*IOPAR_MASK_WORDS(n));
+	if (!ndirty)
+		/* nothing changed */
+		return 0;
+	for (j = 0; j < n; ++j) {
+		id = ids[j];
+		if (packed.size) {
+			/* stream through the packed store */
+			slot = ID_SLOT(id);
+			if ((id <= 0) || (slot >= packed.size) ||
+					(packed.ids[slot] != id) ||
+					!(packed.states[slot] & ST_DIRTY))
+				continue;
+		} else {
+			iopar = _lookup_iopar(id);
+			if (!iopar || !(iopar->state & ST_DIRTY))
+				continue;
+		}
+		mask[j / IOPAR_MASK_BITS] |= 1UL << (j % IOPAR_MASK_BITS);
+		++cnt;
+	}
+	return cnt;
+}
+
 int iopar_dirty(int iopar_id)
 {
 	struct iopar *iopar = _lookup_iopar(iopar_id);
@@ -457,41 +987,214 @@ const char *iopar_name(int iopar_id)
 	return iopar ? iopar->name : NULL;
 }
 
+int iopar_find(const char *name)
+{
+	struct iopar *iopar = libio_index_find(&table, name);
+
+	if (!iopar) {
+		errno = ENODEV;
+		return -1;
+	}
+	return iopar->id;
+}
+
 void libio_flush(void)
 {
+	struct iopar *iopar;
 	int j;
 
 	longdet_flush();
+	/* changes that the application made since the notifiers */
+	for (j = nnotified; j < ndirty; ++j) {
+		iopar = _lookup_iopar(dirtyids[j]);
+		if (iopar && (iopar->state & ST_DIRTY))
+			expr_queue_inputs(iopar);
+	}
 	netio_sync();
-	for (j = 1; j < tablesize; ++j) {
-		if (table[j])
-			table[j]->state &= ~ST_DIRTY;
+	for (j = 0; j < ndirty; ++j) {
+		iopar = _lookup_iopar(dirtyids[j]);
+		if (!iopar)
+			continue;
+		iopar->state &= ~ST_DIRTY;
+		table[ID_SLOT(iopar->id)].notified = 0;
+		if (packed.size)
+			packed.states[ID_SLOT(iopar->id)] &= ~ST_DIRTY;
 	}
+	ndirty = nnotified = 0;
+	/* derived iopars follow those changes, and are dirty
+	 * for the next cycle, so their notifiers run then
+	 */
+	expr_flush();
+}
+
+static inline int tobool(double value)
+{
+	/* >= 0.5 is NAN safe */
+	return (value >= 0.5) ? 1 : 0;
+}
+
+/* test if @notifier wants this change */
+static int notifier_wants(struct iopar_notifier *notifier, struct iopar *iopar)
+{
+	int present = (iopar->state & ST_PRESENT) ? 1 : 0;
+	int result = 0;
+
+	if (!notifier->flags)
+		return 1;
+	if ((notifier->flags & IOPAR_NF_RISING) &&
+			!tobool(notifier->value) && tobool(iopar->value))
+		result = 1;
+	if ((notifier->flags & IOPAR_NF_FALLING) &&
+			tobool(notifier->value) && !tobool(iopar->value))
+		result = 1;
+	if ((notifier->flags & IOPAR_NF_DELTA) &&
+			((isnan(notifier->called) != isnan(iopar->value)) ||
+			 (fabs(iopar->value - notifier->called) >= notifier->delta)))
+		result = 1;
+	if ((notifier->flags & IOPAR_NF_PRESENT) &&
+			(present != notifier->present))
+		result = 1;
+	notifier->value = iopar->value;
+	notifier->present = present;
+	if (result)
+		notifier->called = iopar->value;
+	return result;
 }
 
 static void iopar_notify(struct iopar *iopar)
 {
 	struct iopar_notifier *notifier;
-
-	for (notifier = iopar->notifiers; notifier; notifier = notifier->next)
+	double t0;
+
+	for (notifier = iopar->notifiers; notifier; notifier = notifier->next) {
+		if (!notifier_wants(notifier, iopar))
+			continue;
+		if (!loopstat_on) {
+			notifier->fn(notifier->dat);
+			continue;
+		}
+		t0 = libt_now();
 		notifier->fn(notifier->dat);
+		loopstat_callback(notifier->fn, libt_now() - t0);
+	}
 }
 
-void libio_run_notifiers(void)
+/* notify dirty iopars, starting at dirtyids[@first] */
+static void notify_dirty(int first)
 {
+	struct iopar *iopar;
 	int j;
 
-	for (j = 1; j < tablesize; ++j) {
-		if (table[j] && (table[j]->state & ST_DIRTY))
-			iopar_notify(table[j]);
+	++notifying;
+	/* iopars that become dirty during this loop are notified too */
+	for (j = first; ; ++j) {
+		if (j >= ndirty) {
+			/* recompute derived iopars, they may add dirty iopars */
+			if (!expr_flush())
+				break;
+			if (j >= ndirty)
+				break;
+		}
+		iopar = _lookup_iopar(dirtyids[j]);
+		if (!iopar || !(iopar->state & ST_DIRTY) ||
+				table[ID_SLOT(iopar->id)].notified)
+			continue;
+		table[ID_SLOT(iopar->id)].notified = 1;
+		notifyidx = j;
+		iopar_notify(iopar);
 	}
+	nnotified = ndirty;
+	--notifying;
+}
+
+void libio_run_notifiers(void)
+{
+	notify_dirty(0);
+}
+
+void iopar_notify_pending(struct iopar *iopar)
+{
+	if (!(iopar->state & ST_DIRTY) || notifying)
+		return;
+	notify_dirty(0);
+	/* the next change is notified again */
+	table[ID_SLOT(iopar->id)].notified = 0;
+}
+
+void libio_begin(void)
+{
+	++txn.depth;
+}
+
+int libio_commit(void)
+{
+	struct iopar *iopar;
+	int j, first, wasdirty, nagain, *again, ret = 0;
+	double saved_value;
+
+	if (!txn.depth) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (--txn.depth)
+		/* nested, the outer commit applies */
+		return 0;
+
+	first = ndirty;
+	for (j = nagain = 0; j < txn.nsets; ++j) {
+		iopar = _lookup_iopar(txn.sets[j].id);
+		if (!iopar) {
+			/* destroyed meanwhile */
+			errno = ENODEV;
+			ret = -1;
+			continue;
+		}
+		wasdirty = iopar->state & ST_DIRTY;
+		saved_value = iopar->value;
+		if (_set_iopar(iopar, txn.sets[j].value) < 0)
+			ret = -1;
+		if (!wasdirty || (iopar->value == saved_value))
+			continue;
+		/* changed again, but not pushed on dirtyids again */
+		if (notifying && (table[ID_SLOT(iopar->id)].dirtyidx > notifyidx))
+			/* the running loop did not get here yet */
+			continue;
+		/* collect in place, behind j */
+		txn.sets[nagain++].id = iopar->id;
+	}
+	/* notifiers may start a new transaction */
+	again = NULL;
+	if (nagain) {
+		again = malloc(sizeof(*again)*nagain);
+		if (!again)
+			elog(LOG_CRIT, errno, "malloc");
+		for (j = 0; j < nagain; ++j)
+			again[j] = txn.sets[j].id;
+	}
+	txn.nsets = 0;
+	/* 1 packet for all changes */
+	netio_sync_params();
+	for (j = 0; j < nagain; ++j) {
+		iopar = _lookup_iopar(again[j]);
+		if (!iopar)
+			continue;
+		table[ID_SLOT(iopar->id)].notified = 1;
+		iopar_notify(iopar);
+	}
+	if (again)
+		free(again);
+	if (!notifying)
+		notify_dirty(first);
+	/* else the running loop notifies the new dirty ids */
+	return ret;
 }
 
 /* direct event notifications */
-int iopar_add_notifier(int iopar_id, void (*fn)(void *), void *dat)
+int iopar_add_notifier_flags(int iopar_id, void (*fn)(void *), void *dat,
+		int flags, int prio, double delta)
 {
 	struct iopar *iopar = _lookup_iopar(iopar_id);
-	struct iopar_notifier *notifier;
+	struct iopar_notifier *notifier, **pnot;
 
 	if (!iopar) {
 		errno = ENODEV;
@@ -500,11 +1203,27 @@ int iopar_add_notifier(int iopar_id, void (*fn)(void *), void *dat)
 	notifier = zalloc(sizeof(*notifier));
 	notifier->fn = fn;
 	notifier->dat = dat;
-	notifier->next = iopar->notifiers;
-	iopar->notifiers = notifier;
+	notifier->flags = flags;
+	notifier->prio = prio;
+	notifier->delta = delta;
+	/* changes are seen relative to the current state */
+	notifier->value = notifier->called = iopar->value;
+	notifier->present = (iopar->state & ST_PRESENT) ? 1 : 0;
+	/* insert before the notifiers of equal or lower priority */
+	for (pnot = &iopar->notifiers; *pnot; pnot = &(*pnot)->next) {
+		if ((*pnot)->prio <= prio)
+			break;
+	}
+	notifier->next = *pnot;
+	*pnot = notifier;
 	return 0;
 }
 
+int iopar_add_notifier(int iopar_id, void (*fn)(void *), void *dat)
+{
+	return iopar_add_notifier_flags(iopar_id, fn, dat, 0, 0, 0);
+}
+
 int iopar_del_notifier(int iopar_id, void (*fn)(void *), void *dat)
 {
 	struct iopar *iopar = _lookup_iopar(iopar_id);
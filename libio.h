@@ -13,6 +13,49 @@ extern void elog(int prio, int errnum, const char *fmt, ...)
 
 /* core loop */
 extern int libio_wait(void);
+/* number of wakeups of libio_wait(), starts at 1 */
+extern unsigned long libio_cycle(void);
+/* wake up for timeouts via a timerfd, with nsec instead of msec resolution */
+extern int libio_set_hires(int enable);
+
+/* event loop statistics, times in seconds */
+#define LIBIO_PH_APP		0 /* between libio_wait() calls */
+#define LIBIO_PH_FLUSH		1 /* libio_flush() */
+#define LIBIO_PH_WAIT		2 /* sleeping */
+#define LIBIO_PH_EVENTS		3 /* fd handlers */
+#define LIBIO_PH_TIMERS		4 /* timeout handlers */
+#define LIBIO_PH_NOTIFIERS	5 /* iopar notifiers */
+#define LIBIO_PHASES		6
+/* late[n] counts timeouts that were less than 2^n usec late */
+#define LIBIO_LATEBINS		16
+
+struct libio_loopstat {
+	double elapsed;
+	unsigned long iterations;
+	unsigned long wakeups; /* iterations with events */
+	unsigned long events;
+	int maxevents; /* events of 1 wakeup */
+	double phase[LIBIO_PHASES];
+	unsigned long late[LIBIO_LATEBINS];
+};
+
+/* time spent per callback, of fd handlers, timeouts & notifiers */
+struct libio_cbstat {
+	void *fn;
+	unsigned long count;
+	double total;
+	double max;
+};
+
+/* the loop is measured from the first call of these on,
+ * or from the start when the environment has LIBIO_LOOPSTAT set
+ */
+extern void libio_get_loopstat(struct libio_loopstat *stat);
+/* fill up to @n callbacks that took most time, returns the number filled */
+extern int libio_get_cbstats(struct libio_cbstat *stats, int n);
+extern void libio_reset_loopstat(void);
+/* symbol name of a callback, or file+offset for use with addr2line */
+extern const char *libio_cbname(void *fn);
 
 /* GENERIC */
 extern void register_applet(const char *name, int (*fn)(int, char *[]));
@@ -54,13 +97,36 @@ extern int schedule_itimer(double value);
 
 struct iopar;
 
-/* parameter API */
+/* parameter API
+ * ids are > 0. Once destroyed, an id stays invalid (ENODEV),
+ * also when its slot is reused by a new iopar.
+ */
 extern int create_iopar(const char *str);
 extern int create_ioparf(const char *fmt, ...)
 	__attribute__((format(printf,1,2)));
 extern void destroy_iopar(int iopar);
 extern double get_iopar(int iopar);
 extern int set_iopar(int iopar, double value);
+/* fetch @n values at once from a packed store
+ * Invalid ids yield NAN, and a -1 return with errno ENODEV
+ */
+extern int get_iopars(const int *iopars, double *values, int n);
+
+/* batch API
+ * masks hold 1 bit per entry of the iopars array
+ */
+#define IOPAR_MASK_BITS		(sizeof(unsigned long)*8)
+#define IOPAR_MASK_WORDS(n)	(((n) + IOPAR_MASK_BITS -1) / IOPAR_MASK_BITS)
+#define iopar_mask_test(mask, j) \
+	(((mask)[(j) / IOPAR_MASK_BITS] >> ((j) % IOPAR_MASK_BITS)) & 1)
+
+/* like get_iopars, but only for entries set in @mask, when not NULL */
+extern int get_iopar_v(const int *iopars, double *values, int n,
+		const unsigned long *mask);
+/* set @n values, returns -1 when any failed */
+extern int set_iopar_v(const int *iopars, const double *values, int n);
+/* set a bit in @mask for every dirty iopar, returns the number of dirty iopars */
+extern int iopar_dirty_mask(const int *iopars, int n, unsigned long *mask);
 
 /* return true when iopar is dirty */
 extern int iopar_dirty(int iopar);
@@ -68,6 +134,32 @@ extern int iopar_dirty(int iopar);
 extern int iopar_present(int iopar);
 /* return the name used during construction */
 extern const char *iopar_name(int iopar);
+/* cache values that are fetched on each get_iopar() for @maxage seconds,
+ * or for the current libio_wait() cycle with IOPAR_MAXAGE_CYCLE.
+ * The default 0 fetches always. set_iopar() drops the cached value.
+ */
+#define IOPAR_MAXAGE_CYCLE	-1
+extern int iopar_set_maxage(int iopar, double maxage);
+/* return the iopar created with @name, the last one created when there are more */
+extern int iopar_find(const char *name);
+
+/* arenas: allocate groups of iopars together, and destroy them at once */
+struct libio_arena;
+extern struct libio_arena *libio_arena_new(void);
+/* create new iopars in @arena, NULL for the heap. Returns the previous arena */
+extern struct libio_arena *libio_set_arena(struct libio_arena *arena);
+/* destroy all iopars created in @arena, and release its memory */
+extern void libio_arena_free(struct libio_arena *arena);
+
+struct libio_arenastat {
+	/* bytes */
+	unsigned long used, size;
+	int nchunks;
+	int niopars;
+};
+/* statistics of @arena, or of the heap allocations when NULL */
+extern void libio_get_arenastat(struct libio_arena *arena,
+		struct libio_arenastat *stat);
 
 /* fetch with constant from /etc/libio-const.conf */
 extern const char *libio_strconst(const char *name);
@@ -78,6 +170,21 @@ extern const char *libio_next_const(const char *name);
 /* netio: publish local parameter via this socket */
 extern int libio_bind_net(const char *uri);
 
+/* netio: payload per datagram sent for a socket family (PF_xxx),
+ * 0 restores the default. Datagrams up to 65536 bytes are received
+ * whatever the mtu.
+ */
+extern int netio_set_mtu(int family, int mtu);
+
+/* netio statistics */
+struct libio_netstat {
+	unsigned long sendcalls; /* send syscalls */
+	unsigned long sentpkts; /* datagrams sent */
+	unsigned long recvcalls; /* receive syscalls */
+	unsigned long recvpkts; /* datagrams received */
+};
+extern void libio_get_netstat(struct libio_netstat *stat);
+
 /* netio: probe for remote socket (send a *probe packet) */
 extern int netio_probe_remote(const char *uri);
 
@@ -120,6 +227,17 @@ extern void libio_flush(void);
  */
 extern void libio_run_notifiers(void);
 
+/*
+ * transactions
+ * set_iopar() between libio_begin() and libio_commit() is staged,
+ * and get_iopar() returns the staged value.
+ * libio_commit() applies the last value set to each iopar,
+ * sends 1 netio packet and runs the notifiers of all changed iopars.
+ * Transactions may be nested, the outer libio_commit() applies.
+ */
+extern void libio_begin(void);
+extern int libio_commit(void);
+
 /* set verbosity of libio */
 extern void libio_set_trace(int value);
 
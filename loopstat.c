@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <dlfcn.h>
+
+#include "lib/libt.h"
+#include "lib/libe.h"
+#include "_libio.h"
+
+/* event loop instrumentation */
+
+/* callbacks are accounted in a fixed table,
+ * callbacks that don't fit go to the last entry
+ */
+#define NCBS	128
+
+static struct {
+	struct libio_loopstat stat;
+	double start;
+	/* time of the last mark, 0 before the first */
+	double mark;
+	struct libio_cbstat cbs[NCBS];
+} s;
+
+/* nothing is measured until the stats are requested */
+int loopstat_on;
+
+static const char *const phasenames[LIBIO_PHASES] = {
+	[LIBIO_PH_APP] = "app",
+	[LIBIO_PH_FLUSH] = "flush",
+	[LIBIO_PH_WAIT] = "wait",
+	[LIBIO_PH_EVENTS] = "events",
+	[LIBIO_PH_TIMERS] = "timers",
+	[LIBIO_PH_NOTIFIERS] = "notifiers",
+};
+
+void loopstat_mark(int phase)
+{
+	double now;
+
+	if (!loopstat_on)
+		return;
+	now = libt_now();
+	if (s.mark)
+		s.stat.phase[phase] += now - s.mark;
+	else
+		s.start = now;
+	s.mark = now;
+}
+
+void loopstat_events(int nevents)
+{
+	if (!loopstat_on)
+		return;
+	++s.stat.iterations;
+	if (nevents <= 0)
+		return;
+	++s.stat.wakeups;
+	s.stat.events += nevents;
+	if (nevents > s.stat.maxevents)
+		s.stat.maxevents = nevents;
+}
+
+void loopstat_callback(void *fn, double elapsed)
+{
+	struct libio_cbstat *cb;
+	unsigned int j, n;
+
+	j = ((uintptr_t)fn >> 4) % (NCBS -1);
+	for (n = 0; n < NCBS -1; ++n, j = (j+1) % (NCBS -1)) {
+		if (!s.cbs[j].count || (s.cbs[j].fn == fn))
+			break;
+	}
+	if (n >= NCBS -1)
+		/* table full, account as 'other' */
+		j = NCBS -1;
+	else
+		s.cbs[j].fn = fn;
+	cb = &s.cbs[j];
+	++cb->count;
+	cb->total += elapsed;
+	if (elapsed > cb->max)
+		cb->max = elapsed;
+}
+
+static void loopstat_timer(void *fn, double late, double elapsed)
+{
+	int bin;
+	double usec;
+
+	/* early timers count as in time */
+	for (bin = 0, usec = 1; bin < LIBIO_LATEBINS -1; ++bin, usec *= 2) {
+		if (late*1e6 < usec)
+			break;
+	}
+	++s.stat.late[bin];
+	loopstat_callback(fn, elapsed);
+}
+
+static void loopstat_start(void)
+{
+	if (loopstat_on)
+		return;
+	loopstat_on = 1;
+	libe_set_hook(loopstat_callback);
+	libt_set_hook(loopstat_timer);
+}
+
+__attribute__((constructor))
+static void loopstat_init(void)
+{
+	/* measure from the start, to inspect a daemon later */
+	if (getenv("LIBIO_LOOPSTAT"))
+		loopstat_start();
+}
+
+/* exported API */
+void libio_get_loopstat(struct libio_loopstat *stat)
+{
+	loopstat_start();
+	*stat = s.stat;
+	stat->elapsed = s.mark ? libt_now() - s.start : 0;
+}
+
+static int cmp_cbstat(const void *va, const void *vb)
+{
+	const struct libio_cbstat *a = va, *b = vb;
+
+	return (a->total < b->total) - (a->total > b->total);
+}
+
+int libio_get_cbstats(struct libio_cbstat *stats, int n)
+{
+	struct libio_cbstat all[NCBS];
+	int j, nall;
+
+	loopstat_start();
+	for (j = nall = 0; j < NCBS; ++j) {
+		if (s.cbs[j].count)
+			all[nall++] = s.cbs[j];
+	}
+	qsort(all, nall, sizeof(*all), cmp_cbstat);
+	if (n > nall)
+		n = nall;
+	memcpy(stats, all, sizeof(*stats)*n);
+	return n;
+}
+
+void libio_reset_loopstat(void)
+{
+	loopstat_start();
+	memset(&s.stat, 0, sizeof(s.stat));
+	memset(s.cbs, 0, sizeof(s.cbs));
+	s.start = s.mark ? s.mark : 0;
+}
+
+const char *libio_cbname(void *fn)
+{
+	static char buf[128];
+	Dl_info info;
+	const char *file;
+
+	if (!fn)
+		return "other";
+	if (!dladdr(fn, &info) || !info.dli_fname) {
+		snprintf(buf, sizeof(buf), "%p", fn);
+		return buf;
+	}
+	if (info.dli_sname)
+		return info.dli_sname;
+	/* static function: offset for addr2line */
+	file = strrchr(info.dli_fname, '/');
+	snprintf(buf, sizeof(buf), "%s+%#lx", file ? file+1 : info.dli_fname,
+			(unsigned long)((char *)fn - (char *)info.dli_fbase));
+	return buf;
+}
+
+/* format the stats as 1 line of key=value, for netio */
+int loopstat_format(char *buf, int size)
+{
+	struct libio_loopstat st;
+	struct libio_cbstat cbs[8];
+	int j, n, len;
+	double usec;
+
+	if (!loopstat_on) {
+		/* don't report zeros as if nothing happened */
+		loopstat_start();
+		return snprintf(buf, size, "loopstat=off enabled=now");
+	}
+	libio_get_loopstat(&st);
+	len = snprintf(buf, size, "elapsed=%.3f iterations=%lu rate=%.1f"
+			" wakeups=%lu events=%lu maxevents=%i",
+			st.elapsed, st.iterations,
+			(st.elapsed > 0) ? st.iterations / st.elapsed : 0,
+			st.wakeups, st.events, st.maxevents);
+	for (j = 0; j < LIBIO_PHASES && len < size; ++j)
+		len += snprintf(buf+len, size-len, " t_%s=%.3f",
+				phasenames[j], st.phase[j]);
+	for (j = 0, usec = 1; j < LIBIO_LATEBINS && len < size; ++j, usec *= 2) {
+		if (st.late[j])
+			len += snprintf(buf+len, size-len, " late%s%.0fus=%lu",
+					(j < LIBIO_LATEBINS -1) ? "<" : ">=",
+					(j < LIBIO_LATEBINS -1) ? usec : usec/2,
+					st.late[j]);
+	}
+	n = libio_get_cbstats(cbs, sizeof(cbs)/sizeof(cbs[0]));
+	for (j = 0; j < n && len < size; ++j)
+		len += snprintf(buf+len, size-len, " cb:%s=%lu/%.3f/%.3f",
+				libio_cbname(cbs[j].fn), cbs[j].count,
+				cbs[j].total*1e3, cbs[j].max*1e3);
+	return (len < size) ? len : size -1;
+}
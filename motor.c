@@ -358,9 +358,9 @@ static void cleanup_motorpar(struct motor *mot)
 	change_motor_speed(mot, 0);
 	/* free power resources */
 	if (mot->poweruri)
-		free(mot->poweruri);
+		iopar_free(mot->poweruri);
 	if (mot->powerid)
-		free(mot->powerid);
+		iopar_free(mot->powerid);
 
 	/* cleanup child iopar's */
 	destroy_iopar(mot->out1);
@@ -369,7 +369,7 @@ static void cleanup_motorpar(struct motor *mot)
 	/* cleanup myself */
 	cleanup_libiopar(&mot->pospar);
 	cleanup_libiopar(&mot->dirpar);
-	free(mot);
+	iopar_free(mot);
 }
 
 static void del_motor_dir(struct iopar *iopar)
@@ -417,7 +417,7 @@ struct iopar *mkmotordir(char *str)
 	char *tok, *saved;
 	int ntok;
 
-	mot = zalloc(sizeof(*mot));
+	mot = iopar_zalloc(sizeof(*mot));
 	mot->flags = EOL0 | EOL1;
 	mot->dirpar.del = del_motor_dir;
 	mot->dirpar.set = set_motor_dir;
@@ -474,8 +474,8 @@ struct iopar *mkmotordir(char *str)
 		mot->flags &= ~(EOL0| EOL1);
 	else if (!strncmp("power=", tok, 6)) {
 		tok += 6;
-		mot->poweruri = strdup(strtok(tok, "#"));
-		mot->powerid = strdup(strtok(NULL, ":") ?: "motor");
+		mot->poweruri = iopar_strdup(strtok(tok, "#"));
+		mot->powerid = iopar_strdup(strtok(NULL, ":") ?: "motor");
 		mot->powerval = strtod(strtok(NULL, ":") ?: "1", NULL);
 	}
 
@@ -496,6 +496,6 @@ fail_config:
 		destroy_iopar(mot->out2);
 	if (mot->out1)
 		destroy_iopar(mot->out1);
-	free(mot);
+	iopar_free(mot);
 	return NULL;
 }
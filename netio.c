@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <math.h>
 
 #include <unistd.h>
@@ -33,16 +35,21 @@ struct sockparam {
 	struct ioremote *remote;
 	struct sockparam *next;
 	double newvalue;
+	/* index in the binary name table, -1 for none */
+	int binidx;
 	int state;
 		#define ST_WRITABLE	0x01
 		#define ST_WAITING	0x02 /* waiting for transmission, ... */
 		#define ST_NEW		0x04 /* newly created: transmit without dirty ... */
+		#define ST_CHANGED	0x08 /* local value to publish */
 
 	char name[2];
 };
 
 struct ioremote {
 	struct ioremote *next;
+	/* next in hash bucket */
+	struct ioremote *hnext;
 	struct iosocket *sock;
 	struct sockparam *params;
 	union sockaddrs name;
@@ -50,7 +57,24 @@ struct ioremote {
 	int flags;
 		#define FL_SENDTO	0x01
 		#define FL_RECVFROM	0x02
+		#define FL_BLOCKED	0x04 /* socket was full, resync when writable */
+		#define FL_BINARY	0x08 /* binary updates negotiated */
+		#define FL_TEXT		0x10 /* don't ask for binary updates */
 	time_t last_recvfrom_time;
+	/*
+	 * binary name table: the generation that this subscriber got,
+	 * or that the publisher sent, -1 for none.
+	 * The subscriber maps the indexes to its params.
+	 */
+	int bingen;
+	struct sockparam **bintab;
+	int nbintab;
+	/* name table entries received, and announced in *initial bin */
+	int binnames, binexpect;
+	/* don't ask for the name table again before */
+	double nextsubscribe;
+	/* datagrams of name table tabgen that went out to a full socket */
+	int tabsent, tabgen;
 };
 
 struct iosocket {
@@ -66,6 +90,7 @@ struct iosocket {
 		 *    results in a new socket address.
 		 */
 		#define FL_MYPUBLIC_SOCK	0x01
+		#define FL_WRITEWAIT		0x02 /* waiting for LIBE_OUT */
 };
 
 struct netiomsg {
@@ -77,7 +102,22 @@ struct netiomsg {
 };
 
 #define NETIO_MTU	1500
+/*
+ * default payload per datagram: no IP fragmentation over ethernet,
+ * unix sockets don't fragment at all
+ */
+#define NETIO_MTU_INET	(1500-20-8)
+#define NETIO_MTU_INET6	(1500-40-8)
+#define NETIO_MTU_UNIX	16384
+/* largest datagram that we accept */
+#define NETIO_MAXMTU	65536
 #define NETIO_PINGTIME	1
+/* keepalives may be late, remotes are only lost after 2*NETIO_PINGTIME */
+#define NETIO_PINGSLACK	(NETIO_PINGTIME/8.0)
+/* retry sending to full sockets */
+#define NETIO_RETRYTIME	0.01
+/* minimal time between requests for a name table */
+#define NETIO_RESUBTIME	0.1
 
 #define NIOSOCKETS PF_MAX
 static struct iosocket *iosockets[PF_MAX];
@@ -90,8 +130,138 @@ static struct netiomsg *netiomsgp;
 static unsigned int netiomsgid;
 static int netiomsg_acked;
 
-/* locally used buffer */
-static char pktbuf[NETIO_MTU+1];
+/* payload per datagram, per family, 0 for the default */
+static int netio_mtus[NIOSOCKETS];
+
+/*
+ * receive buffers, for 1 batch of datagrams
+ * Remotes may send up to NETIO_MAXMTU, whatever our own mtu is,
+ * so each buffer takes NETIO_MAXMTU. They are allocated on the first
+ * receive and never cleared, so only the pages that datagrams
+ * reached become resident.
+ */
+#define NETIO_RECVBATCH	16
+/* batches per wakeup, leave time for other fds */
+#define NETIO_RECVLOOPS	4
+static struct {
+	char *buf;
+	/* per datagram, without null terminator */
+	int bufsize;
+	int nbufs;
+} rx;
+
+/*
+ * outgoing datagrams
+ * Lines (or binary records) are appended to the current datagram
+ * and start a new one when the mtu would be exceeded.
+ * A binary datagram repeats the header.
+ */
+struct pktq {
+	char *buf;
+	int len, size;
+	/* end of each datagram in buf */
+	int *ends;
+	int npkts, endssize;
+	int mtu;
+	char hdr[4];
+	int hdrlen;
+};
+
+static struct pktq txtq, binq;
+
+static struct libio_netstat netstat;
+
+/*
+ * binary format
+ * A binary packet starts with a 0 byte, which an old peer sees as
+ * an empty text packet, followed by the 16bit little endian generation
+ * of the name table.
+ * Each parameter follows as varint index in the name table,
+ * a flags byte and the value: nothing, a zigzag varint or
+ * a little endian double.
+ * The name table is sent as text (*initial bin GEN COUNT, *name IDX NAME)
+ * after a "*subscribe bin GEN", GEN being the table that the subscriber has.
+ * A subscriber that got less than COUNT names asks for the table again.
+ * Remotes are asked as text with a '?text' uri option, like unix:/sock?text#param
+ */
+#define BIN_INT		0x01 /* integer value, as zigzag varint */
+#define BIN_NAN		0x02 /* no value */
+/* header + largest record */
+#define BIN_HDRLEN	3
+#define BIN_MAXREC	(5+1+8)
+/* limit of name table indexes that a subscriber accepts */
+#define BIN_MAXTAB	(1 << 16)
+
+/* local parameters by index in the name table */
+static struct sockparam **localtab;
+static int nlocaltab;
+/* used entries in localtab */
+static int nlocalnames;
+/* stack of free indexes in localtab, lowest on top */
+static int *localfree;
+static int nlocalfree;
+/* changes when the name table changes, 16bit on the wire */
+static int localgen;
+#define BIN_GENMASK	0xffff
+
+__attribute__((destructor))
+static void free_localtab(void)
+{
+	if (localtab)
+		free(localtab);
+	if (localfree)
+		free(localfree);
+}
+
+static void localtab_add(struct sockparam *par)
+{
+	int j;
+
+	if (!nlocalfree) {
+		localtab = realloc(localtab, sizeof(*localtab)*(nlocaltab+16));
+		localfree = realloc(localfree, sizeof(*localfree)*(nlocaltab+16));
+		if (!localtab || !localfree)
+			elog(LOG_CRIT, errno, "realloc");
+		memset(localtab+nlocaltab, 0, sizeof(*localtab)*16);
+		for (j = nlocaltab+15; j >= nlocaltab; --j)
+			localfree[nlocalfree++] = j;
+		nlocaltab += 16;
+	}
+	j = localfree[--nlocalfree];
+	localtab[j] = par;
+	par->binidx = j;
+	++nlocalnames;
+	localgen = (localgen + 1) & BIN_GENMASK;
+}
+
+static void localtab_del(struct sockparam *par)
+{
+	if (par->binidx < 0)
+		return;
+	localtab[par->binidx] = NULL;
+	localfree[nlocalfree++] = par->binidx;
+	par->binidx = -1;
+	--nlocalnames;
+	localgen = (localgen + 1) & BIN_GENMASK;
+}
+
+/* subscriber side: forget the name table of a remote */
+static void bintab_clear(struct ioremote *remote)
+{
+	int j;
+
+	for (j = 0; j < remote->nbintab; ++j) {
+		if (remote->bintab[j])
+			remote->bintab[j]->binidx = -1;
+	}
+	if (remote->bintab)
+		free(remote->bintab);
+	remote->bintab = NULL;
+	remote->nbintab = 0;
+	remote->binnames = remote->binexpect = 0;
+	remote->bingen = -1;
+	remote->flags &= ~FL_BINARY;
+}
 
 /* list management */
 static void add_sockparam(struct sockparam *par, struct ioremote *rem)
@@ -102,6 +272,10 @@ static void add_sockparam(struct sockparam *par, struct ioremote *rem)
 	*ppar = par;
 
 	par->remote = rem;
+	par->binidx = -1;
+	libio_index_add(ppar, par->name, par);
+	if (!rem)
+		localtab_add(par);
 }
 
 static void del_sockparam(struct sockparam *par)
@@ -109,6 +283,13 @@ static void del_sockparam(struct sockparam *par)
 	struct sockparam **ppar =
 		par->remote ? &par->remote->params : &localparams;
 
+	libio_index_del(ppar, par->name, par);
+	if (!par->remote)
+		localtab_del(par);
+	else if (par->binidx >= 0) {
+		par->remote->bintab[par->binidx] = NULL;
+		par->binidx = -1;
+	}
 	for (; *ppar; ppar = &(*ppar)->next) {
 		if (*ppar == par) {
 			*ppar = par->next;
@@ -117,11 +298,92 @@ static void del_sockparam(struct sockparam *par)
 	}
 }
 
+/* remotes, hashed by socket & address */
+static struct {
+	struct ioremote **buckets;
+	int nbuckets, nremotes;
+} rhash;
+
+__attribute__((destructor))
+static void free_rhash(void)
+{
+	if (rhash.buckets)
+		free(rhash.buckets);
+	rhash.buckets = NULL;
+	rhash.nbuckets = 0;
+}
+
+static unsigned int remote_hash(struct iosocket *sock, const void *name, int namelen)
+{
+	/* FNV-1a, seeded with the socket */
+	unsigned int hash = 2166136261u ^ (unsigned int)(uintptr_t)sock;
+	const unsigned char *dat = name;
+	int j;
+
+	for (j = 0; j < namelen; ++j)
+		hash = (hash ^ dat[j]) * 16777619u;
+	return hash;
+}
+
+static inline struct ioremote **remote_bucket(struct iosocket *sock,
+		const void *name, int namelen)
+{
+	return &rhash.buckets[remote_hash(sock, name, namelen) & (rhash.nbuckets -1)];
+}
+
+static void rhash_grow(void)
+{
+	struct ioremote **buckets, *rem, **prem;
+	int j, nbuckets;
+
+	nbuckets = rhash.nbuckets ? rhash.nbuckets*2 : 16;
+	buckets = rhash.buckets;
+	rhash.buckets = zalloc(sizeof(*rhash.buckets)*nbuckets);
+	for (j = 0; j < rhash.nbuckets; ++j) {
+		while (buckets[j]) {
+			rem = buckets[j];
+			buckets[j] = rem->hnext;
+			prem = &rhash.buckets[remote_hash(rem->sock, &rem->name,
+					rem->namelen) & (nbuckets -1)];
+			rem->hnext = *prem;
+			*prem = rem;
+		}
+	}
+	if (buckets)
+		free(buckets);
+	rhash.nbuckets = nbuckets;
+}
+
+static struct ioremote *find_ioremote(struct iosocket *sock,
+		const void *name, int namelen)
+{
+	struct ioremote *rem;
+
+	if (!rhash.nbuckets)
+		return NULL;
+	for (rem = *remote_bucket(sock, name, namelen); rem; rem = rem->hnext) {
+		if (rem->sock == sock && rem->namelen == namelen &&
+				!memcmp(&rem->name, name, namelen))
+			return rem;
+	}
+	return NULL;
+}
+
 static void add_ioremote(struct ioremote *rem, struct iosocket *sock)
 {
+	struct ioremote **prem;
+
 	rem->next = sock->remotes;
 	sock->remotes = rem;
 	rem->sock = sock;
+	rem->bingen = rem->tabgen = -1;
+
+	if (rhash.nremotes >= rhash.nbuckets)
+		rhash_grow();
+	prem = remote_bucket(sock, &rem->name, rem->namelen);
+	rem->hnext = *prem;
+	*prem = rem;
+	++rhash.nremotes;
 }
 
 static void del_ioremote(struct ioremote *rem)
@@ -134,6 +396,17 @@ static void del_ioremote(struct ioremote *rem)
 			break;
 		}
 	}
+	if (rhash.nbuckets) {
+		for (prem = remote_bucket(rem->sock, &rem->name, rem->namelen);
+				*prem; prem = &(*prem)->hnext) {
+			if (*prem == rem) {
+				*prem = rem->hnext;
+				--rhash.nremotes;
+				break;
+			}
+		}
+	}
+	bintab_clear(rem);
 }
 
 /* network address translation, returns addr_len */
@@ -217,11 +490,441 @@ int netio_strtosockname(const char *uri, void *paddr, int family)
 	}
 }
 
+/* (re)subscribe, binary unless the remote was asked as text */
+static int netio_subscribe(struct ioremote *remote)
+{
+	char pkt[32];
+
+	if (remote->flags & FL_TEXT)
+		strcpy(pkt, "*subscribe\n");
+	else
+		/* tell the name table I have */
+		sprintf(pkt, "*subscribe bin %i\n", (remote->flags & FL_BINARY) ?
+				remote->bingen : -1);
+	return sendto(remote->sock->fd, pkt, strlen(pkt), 0,
+			&remote->name.sa, remote->namelen);
+}
+
+static void netio_lost_remote(void *param)
+{
+	struct ioremote *remote = param;
+
+	if (!(remote->flags & FL_SENDTO)) {
+		/*
+		 * I subscribe to this remote's parameters
+		 * Keep the parameters alive and keep subscribing,
+		 * the remote may come back some day
+		 */
+		struct sockparam *par;
+
+		for (par = remote->params; par; par = par->next)
+			iopar_clr_present(&par->iopar);
+	} else {
+		/* no parameters to receive, just drop the remote */
+		while (remote->params) {
+			struct sockparam *par = remote->params;
+
+			del_sockparam(par);
+			/* set parameter lost + dirty */
+			iopar_clr_present(&par->iopar);
+		}
+		del_ioremote(remote);
+		free(remote);
+	}
+}
+
+static void pkt_free(struct pktq *q)
+{
+	if (q->buf)
+		free(q->buf);
+	if (q->ends)
+		free(q->ends);
+	memset(q, 0, sizeof(*q));
+}
+
+__attribute__((destructor))
+static void free_pktqs(void)
+{
+	pkt_free(&txtq);
+	pkt_free(&binq);
+}
+
+static int netio_mtu(int family)
+{
+	if (netio_mtus[family])
+		return netio_mtus[family];
+	switch (family) {
+	case PF_UNIX:
+		return NETIO_MTU_UNIX;
+	case PF_INET6:
+		return NETIO_MTU_INET6;
+	default:
+		return NETIO_MTU_INET;
+	}
+}
+
+void libio_get_netstat(struct libio_netstat *stat)
+{
+	*stat = netstat;
+}
+
+int netio_set_mtu(int family, int mtu)
+{
+	if ((family < 0) || (family >= NIOSOCKETS) ||
+			(mtu && ((mtu < 64) || (mtu > NETIO_MAXMTU)))) {
+		errno = EINVAL;
+		return -1;
+	}
+	netio_mtus[family] = mtu;
+	return 0;
+}
+
+static void pkt_start(struct pktq *q, int mtu, const void *hdr, int hdrlen)
+{
+	q->len = q->npkts = 0;
+	q->mtu = mtu;
+	if (hdrlen)
+		memcpy(q->hdr, hdr, hdrlen);
+	q->hdrlen = hdrlen;
+}
+
+static inline int pkt_offset(struct pktq *q, int j)
+{
+	return j ? q->ends[j-1] : 0;
+}
+
+static void pkt_end(struct pktq *q)
+{
+	int start = pkt_offset(q, q->npkts);
+
+	if (q->len - start <= q->hdrlen) {
+		/* nothing but the header */
+		q->len = start;
+		return;
+	}
+	if (q->npkts >= q->endssize) {
+		q->endssize = q->endssize ? q->endssize*2 : 16;
+		q->ends = realloc(q->ends, sizeof(*q->ends)*q->endssize);
+		if (!q->ends)
+			elog(LOG_CRIT, errno, "realloc");
+	}
+	q->ends[q->npkts++] = q->len;
+}
+
+/*
+ * make room for size bytes in the current datagram,
+ * returns where to put them, or NULL when they would never fit
+ */
+static char *pkt_room(struct pktq *q, int size)
+{
+	static int warned;
+	int start = pkt_offset(q, q->npkts);
+
+	if (q->hdrlen + size > q->mtu) {
+		if (!warned++)
+			elog(LOG_WARNING, 0, "netio: %i bytes exceed mtu %i, dropped",
+					size, q->mtu);
+		return NULL;
+	}
+	if (q->len - start + size > q->mtu) {
+		pkt_end(q);
+		start = q->len;
+	}
+	/* room for the header and the null terminator of vsnprintf */
+	if (q->len + q->hdrlen + size + 1 > q->size) {
+		q->size = (q->size ?: 4096);
+		while (q->size < q->len + q->hdrlen + size + 1)
+			q->size *= 2;
+		q->buf = realloc(q->buf, q->size);
+		if (!q->buf)
+			elog(LOG_CRIT, errno, "realloc");
+	}
+	if (q->len == start) {
+		memcpy(q->buf+q->len, q->hdr, q->hdrlen);
+		q->len += q->hdrlen;
+	}
+	return q->buf+q->len;
+}
+
+/* append a line to the text datagrams */
+__attribute__((format(printf,2,3)))
+static void pkt_printf(struct pktq *q, const char *fmt, ...)
+{
+	va_list va;
+	char *dst;
+	int ret;
+
+	va_start(va, fmt);
+	ret = vsnprintf(NULL, 0, fmt, va);
+	va_end(va);
+	dst = pkt_room(q, ret);
+	if (!dst)
+		return;
+	va_start(va, fmt);
+	vsnprintf(dst, ret+1, fmt, va);
+	va_end(va);
+	q->len += ret;
+}
+
+/* binary encoding */
+static int bin_put_varint(unsigned char *buf, uint32_t value)
+{
+	int len = 0;
+
+	for (; value >= 0x80; value >>= 7)
+		buf[len++] = (value & 0x7f) | 0x80;
+	buf[len++] = value;
+	return len;
+}
+
+static int bin_get_varint(const unsigned char *buf, int size, uint32_t *pvalue)
+{
+	int len, shift;
+	uint32_t value = 0;
+
+	for (len = shift = 0; (len < size) && (shift < 32); ++len, shift += 7) {
+		value |= (uint32_t)(buf[len] & 0x7f) << shift;
+		if (!(buf[len] & 0x80)) {
+			*pvalue = value;
+			return len+1;
+		}
+	}
+	return -1;
+}
+
+/* append 1 parameter to the binary datagrams */
+static void bin_put_param(struct pktq *q, int idx, double value)
+{
+	union {
+		double d;
+		uint64_t u;
+	} v;
+	int j, len;
+	int32_t i;
+	unsigned char *buf;
+
+	buf = (unsigned char *)pkt_room(q, BIN_MAXREC);
+	if (!buf)
+		return;
+	len = bin_put_varint(buf, idx);
+	if (isnan(value)) {
+		buf[len++] = BIN_NAN;
+	} else if ((fabs(value) < 2147483648.0) && (value == trunc(value))) {
+		/* range checked before the cast */
+		i = value;
+		buf[len++] = BIN_INT;
+		len += bin_put_varint(buf+len, ((uint32_t)i << 1) ^ (i >> 31));
+	} else {
+		buf[len++] = 0;
+		v.d = value;
+		for (j = 0; j < 8; ++j, v.u >>= 8)
+			buf[len++] = v.u & 0xff;
+	}
+	q->len += len;
+}
+
+static int bin_get_param(const unsigned char *buf, int size,
+		uint32_t *pidx, double *pvalue)
+{
+	union {
+		double d;
+		uint64_t u;
+	} v;
+	uint32_t u;
+	int len, ret, j;
+
+	len = bin_get_varint(buf, size, pidx);
+	if ((len < 0) || (len >= size))
+		return -1;
+	switch (buf[len++]) {
+	case BIN_NAN:
+		*pvalue = NAN;
+		return len;
+	case BIN_INT:
+		ret = bin_get_varint(buf+len, size-len, &u);
+		if (ret < 0)
+			return -1;
+		*pvalue = (int32_t)((u >> 1) ^ -(u & 1));
+		return len+ret;
+	case 0:
+		if (len + 8 > size)
+			return -1;
+		for (j = 7, v.u = 0; j >= 0; --j)
+			v.u = (v.u << 8) | buf[len+j];
+		*pvalue = v.d;
+		return len+8;
+	default:
+		return -1;
+	}
+}
+
+static inline void bin_start(int mtu)
+{
+	unsigned char hdr[BIN_HDRLEN] = { 0, localgen, localgen >> 8, };
+
+	pkt_start(&binq, mtu, hdr, BIN_HDRLEN);
+}
+
+/* fill txtq with the binary name table,
+ * only the first datagram starts a new table
+ */
+static void netio_fill_bintab(int mtu)
+{
+	int j;
+
+	pkt_start(&txtq, mtu, NULL, 0);
+	pkt_printf(&txtq, "*initial bin %i %i\n", localgen, nlocalnames);
+	for (j = 0; j < nlocaltab; ++j) {
+		if (localtab[j])
+			pkt_printf(&txtq, "*name %i %s\n", j, localtab[j]->name);
+	}
+	pkt_end(&txtq);
+}
+
+/* fill binq with all local parameters */
+static void netio_fill_bin(int mtu)
+{
+	int j;
+
+	bin_start(mtu);
+	for (j = 0; j < nlocaltab; ++j) {
+		if (localtab[j])
+			bin_put_param(&binq, j, localtab[j]->iopar.value);
+	}
+	pkt_end(&binq);
+}
+
+/* output backpressure
+ * Updates are not queued for a full socket. The remote is marked
+ * blocked instead, and gets the complete current state when the socket
+ * accepts data again. This way, no update gets lost, and no memory
+ * is spent on outdated values.
+ */
+static void netio_wait_writable(struct iosocket *sk)
+{
+	if (sk->flags & FL_WRITEWAIT)
+		return;
+	sk->flags |= FL_WRITEWAIT;
+	libe_mod_fd(sk->fd, LIBE_IN | LIBE_OUT);
+}
+
+/* send without blocking, returns 0 when the socket is full */
+static int netio_send_remote(struct ioremote *remote, const char *buf, int len)
+{
+	int ret;
+
+	ret = sendto(remote->sock->fd, buf, len, MSG_DONTWAIT,
+			&remote->name.sa, remote->namelen);
+	++netstat.sendcalls;
+	if (ret >= 0)
+		++netstat.sentpkts;
+	if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		remote->flags |= FL_BLOCKED;
+		netio_wait_writable(remote->sock);
+		return 0;
+	}
+	return ret;
+}
+
+/*
+ * fan-out: 1 datagram to many remotes of 1 socket,
+ * with sendmmsg, or sendto when the kernel lacks it
+ */
+static struct {
+	struct mmsghdr *msgs;
+	struct ioremote **remotes;
+	int n, size;
+	int nosendmmsg;
+} fan;
+
+__attribute__((destructor))
+static void free_fan(void)
+{
+	if (fan.msgs)
+		free(fan.msgs);
+	if (fan.remotes)
+		free(fan.remotes);
+	memset(&fan, 0, sizeof(fan));
+}
+
+static void fan_add(struct ioremote *remote)
+{
+	if (fan.n >= fan.size) {
+		fan.size = fan.size ? fan.size*2 : 16;
+		fan.msgs = realloc(fan.msgs, sizeof(*fan.msgs)*fan.size);
+		fan.remotes = realloc(fan.remotes, sizeof(*fan.remotes)*fan.size);
+		if (!fan.msgs || !fan.remotes)
+			elog(LOG_CRIT, errno, "realloc");
+	}
+	fan.remotes[fan.n++] = remote;
+}
+
+/* send buf to the remotes added with fan_add() */
+static void netio_fan_send(struct iosocket *sk, const void *buf, int len)
+{
+	struct iovec iov = {
+		.iov_base = (void *)buf,
+		.iov_len = len,
+	};
+	struct ioremote *remote;
+	int j, ret;
+
+	for (j = 0; j < fan.n; ++j) {
+		remote = fan.remotes[j];
+		memset(&fan.msgs[j], 0, sizeof(fan.msgs[j]));
+		fan.msgs[j].msg_hdr.msg_name = &remote->name;
+		fan.msgs[j].msg_hdr.msg_namelen = remote->namelen;
+		/* all share the payload */
+		fan.msgs[j].msg_hdr.msg_iov = &iov;
+		fan.msgs[j].msg_hdr.msg_iovlen = 1;
+	}
+	for (j = 0; j < fan.n; ) {
+		remote = fan.remotes[j];
+		if (!fan.nosendmmsg) {
+			ret = sendmmsg(sk->fd, fan.msgs+j, fan.n-j, MSG_DONTWAIT);
+			if ((ret < 0) && (errno == ENOSYS)) {
+				fan.nosendmmsg = 1;
+				continue;
+			}
+		} else {
+			ret = sendto(sk->fd, buf, len, MSG_DONTWAIT,
+					&remote->name.sa, remote->namelen);
+			if (ret >= 0)
+				/* 1 datagram */
+				ret = 1;
+		}
+		++netstat.sendcalls;
+		if (ret > 0) {
+			netstat.sentpkts += ret;
+			j += ret;
+			continue;
+		}
+		/* the first remote failed */
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+			remote->flags |= FL_BLOCKED;
+			netio_wait_writable(sk);
+		} else if (errno != ECONNREFUSED)
+			elog(LOG_WARNING, errno, "netio fan-out");
+		++j;
+	}
+	fan.n = 0;
+}
+
+/* ask for the name table, at most once per NETIO_RESUBTIME */
+static void netio_resubscribe(struct ioremote *remote)
+{
+	double now = libt_now();
+
+	if (now < remote->nextsubscribe)
+		return;
+	remote->nextsubscribe = now + NETIO_RESUBTIME;
+	netio_subscribe(remote);
+}
+
 /* timers */
 static void netio_keepalive(void *dat)
 {
 	static const char pktmst[] = "*keepalive\n";
-	static const char pktslv[] = "*subscribe\n";
 	int j;
 	struct ioremote *remote;
 
@@ -229,20 +932,17 @@ static void netio_keepalive(void *dat)
 	for (j = 0; j < NIOSOCKETS; ++j) {
 		if (!pubsockets[j])
 			continue;
-		for (remote = pubsockets[j]->remotes; remote; remote = remote->next) {
-			sendto(pubsockets[j]->fd, pktmst, sizeof(pktmst), 0,
-						&remote->name.sa, remote->namelen);
-		}
+		for (remote = pubsockets[j]->remotes; remote; remote = remote->next)
+			fan_add(remote);
+		netio_fan_send(pubsockets[j], pktmst, sizeof(pktmst));
 	}
 	for (j = 0; j < NIOSOCKETS; ++j) {
 		if (!iosockets[j])
 			continue;
-		for (remote = iosockets[j]->remotes; remote; remote = remote->next) {
-			sendto(iosockets[j]->fd, pktslv, sizeof(pktslv), 0,
-						&remote->name.sa, remote->namelen);
-		}
+		for (remote = iosockets[j]->remotes; remote; remote = remote->next)
+			netio_subscribe(remote);
 	}
-	libt_add_timeout(NETIO_PINGTIME, netio_keepalive, dat);
+	libt_add_timeout_slack(NETIO_PINGTIME, NETIO_PINGSLACK, netio_keepalive, dat);
 }
 
 static void netio_schedule_keepalive(void)
@@ -250,75 +950,229 @@ static void netio_schedule_keepalive(void)
 	static int netio_keepalive_scheduled;
 
 	if (!netio_keepalive_scheduled)
-		libt_add_timeout(NETIO_PINGTIME, netio_keepalive, NULL);
+		libt_add_timeout_slack(NETIO_PINGTIME, NETIO_PINGSLACK,
+				netio_keepalive, NULL);
 	netio_keepalive_scheduled = 1;
 }
 
-static void netio_lost_remote(void *param)
+/* send the datagrams of q, from the first,
+ * returns the first one that did not go out to a full socket
+ */
+static int netio_send_pkts(struct ioremote *remote, struct pktq *q, int first)
 {
-	struct ioremote *remote = param;
+	int j, ret;
+
+	for (j = first; j < q->npkts; ++j) {
+		ret = netio_send_remote(remote, q->buf + pkt_offset(q, j),
+				q->ends[j] - pkt_offset(q, j));
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			break;
+	}
+	return j;
+}
 
-	if (!(remote->flags & FL_SENDTO)) {
-		/*
-		 * I subscribe to this remote's parameters
-		 * Keep the parameters alive and keep subscribing,
-		 * the remote may come back some day
-		 */
-		struct sockparam *par;
+static inline int remote_mtu(struct ioremote *remote)
+{
+	return netio_mtu(remote->name.sa.sa_family);
+}
 
-		for (par = remote->params; par; par = par->next)
-			iopar_clr_present(&par->iopar);
-	} else {
-		/* no parameters to receive, just drop the remote */
-		while (remote->params) {
-			struct sockparam *par = remote->params;
+/* fill txtq with remote write requests */
+static int netio_fill_writes(struct ioremote *remote)
+{
+	struct sockparam *par;
 
-			del_sockparam(par);
-			/* set parameter lost + dirty */
-			iopar_clr_present(&par->iopar);
+	pkt_start(&txtq, remote_mtu(remote), NULL, 0);
+	for (par = remote->params; par; par = par->next) {
+		if (par->state & ST_WAITING)
+			pkt_printf(&txtq, "%s>%lf\n",
+					par->name, par->newvalue);
+	}
+	pkt_end(&txtq);
+	return txtq.npkts;
+}
+
+static void netio_clr_writes(struct ioremote *remote)
+{
+	struct sockparam *par;
+
+	for (par = remote->params; par; par = par->next)
+		par->state &= ~ST_WAITING;
+}
+
+/* fill txtq with all local parameters */
+static int netio_fill_local(int mtu, const char *intro)
+{
+	struct sockparam *par;
+
+	pkt_start(&txtq, mtu, NULL, 0);
+	if (intro)
+		pkt_printf(&txtq, "%s", intro);
+	for (par = localparams; par; par = par->next) {
+		pkt_printf(&txtq, "%s=%lf\n",
+				par->name, par->iopar.value);
+	}
+	pkt_end(&txtq);
+	return txtq.npkts;
+}
+
+/* send the name table when changed, and all values to a binary subscriber */
+static int netio_send_binstate(struct ioremote *remote)
+{
+	int ret;
+
+	if (remote->bingen != localgen) {
+		netio_fill_bintab(remote_mtu(remote));
+		if (remote->tabgen != localgen) {
+			remote->tabgen = localgen;
+			remote->tabsent = 0;
 		}
-		del_ioremote(remote);
-		free(remote);
+		/* a big table continues where the full socket stopped it */
+		ret = netio_send_pkts(remote, &txtq, remote->tabsent);
+		if (ret < 0)
+			return ret;
+		remote->tabsent = ret;
+		if (ret < txtq.npkts)
+			return 0;
+		remote->bingen = localgen;
 	}
+	netio_fill_bin(remote_mtu(remote));
+	return netio_send_pkts(remote, &binq, 0);
+}
+
+static void netio_retry(void *dat)
+{
+	struct iosocket *sk = dat;
+	struct ioremote *remote;
+	int n;
+
+	sk->flags &= ~FL_WRITEWAIT;
+	libe_mod_fd(sk->fd, LIBE_IN);
+	for (remote = sk->remotes; remote; remote = remote->next) {
+		if (!(remote->flags & FL_BLOCKED))
+			continue;
+		remote->flags &= ~FL_BLOCKED;
+		if ((sk->flags & FL_MYPUBLIC_SOCK) && (remote->flags & FL_BINARY)) {
+			if (netio_send_binstate(remote) < 0)
+				elog(LOG_WARNING, errno, "netio resync");
+			continue;
+		}
+		if (sk->flags & FL_MYPUBLIC_SOCK)
+			n = netio_fill_local(remote_mtu(remote), NULL);
+		else
+			n = netio_fill_writes(remote);
+		if (n && (netio_send_pkts(remote, &txtq, 0) < 0))
+			elog(LOG_WARNING, errno, "netio resync");
+		if (!(remote->flags & FL_BLOCKED) && !(sk->flags & FL_MYPUBLIC_SOCK))
+			netio_clr_writes(remote);
+	}
+	if (sk->flags & FL_WRITEWAIT) {
+		/*
+		 * Still full. LIBE_OUT does not reflect a full peer
+		 * on unix sockets, so poll a bit later instead
+		 */
+		sk->flags &= ~FL_WRITEWAIT;
+		libe_mod_fd(sk->fd, LIBE_IN);
+		libt_add_timeout(NETIO_RETRYTIME, netio_retry, sk);
+	} else
+		libt_remove_timeout(netio_retry, sk);
 }
 
 /* Device */
-static struct sockparam *find_param(const char *name, struct sockparam *list)
+static struct sockparam *find_param(const char *name, struct sockparam **plist)
+{
+	/* the list head is the index owner */
+	return libio_index_find(plist, name);
+}
+
+/* subscriber side: binary update */
+static void netio_recv_bin(struct ioremote *remote, const unsigned char *buf, int size)
 {
-	for (; list; list = list->next) {
-		if (!strcmp(list->name, name))
-			return list;
+	struct sockparam *par;
+	uint32_t idx;
+	double value;
+	int len, ret;
+
+	if (!(remote->flags & FL_BINARY) ||
+			((buf[1] | (buf[2] << 8)) != remote->bingen)) {
+		/* unknown or changed name table, ask again */
+		netio_resubscribe(remote);
+		return;
+	}
+	for (len = BIN_HDRLEN; len < size; len += ret) {
+		ret = bin_get_param(buf+len, size-len, &idx, &value);
+		if (ret < 0) {
+			elog(LOG_WARNING, 0, "netio: bad binary packet");
+			return;
+		}
+		par = (idx < remote->nbintab) ? remote->bintab[idx] : NULL;
+		if (!par)
+			continue;
+		if (value != par->iopar.value)
+			/* keep the edges of a burst */
+			iopar_notify_pending(&par->iopar);
+		par->iopar.value = value;
+		iopar_set_dirty(&par->iopar);
+		iopar_set_present(&par->iopar);
+		if (libio_trace >= 3)
+			fprintf(stderr, "netio:%s %lf\n", par->name, value);
+	}
+	if (remote->binnames < remote->binexpect) {
+		/* lost part of the name table, my param may be in it */
+		remote->bingen = -1;
+		netio_resubscribe(remote);
 	}
-	return NULL;
 }
 
-static void read_iosocket(int fd, void *data)
+/* subscriber side: entry of the binary name table */
+static void netio_recv_binname(struct ioremote *remote, char *str)
 {
-	struct iosocket *sk = data;
-	struct ioremote *remote;
 	struct sockparam *par;
-	socklen_t namelen;
-	int ret, recvlen, saved_remote_flags;
-	char *tok, *dat, *savedstr;
-	union sockaddrs name;
+	char *name;
+	unsigned long idx;
+	int size;
 
-	/* fetch packet */
-	namelen = sizeof(name);
-	recvlen = ret = recvfrom(fd, pktbuf, NETIO_MTU, 0, &name.sa, &namelen);
-	if (ret < 0) {
-		libe_remove_fd(fd);
-		close(fd);
-		/* TODO: proper cleanup */
+	errno = 0;
+	idx = strtoul(str, &name, 10);
+	if ((name == str) || errno || (*name++ != ' '))
+		return;
+	++remote->binnames;
+	if (idx >= BIN_MAXTAB) {
+		elog(LOG_WARNING, 0, "netio: name index %lu out of range", idx);
 		return;
 	}
-	pktbuf[recvlen] = 0;
+	par = find_param(name, &remote->params);
+	if (!par)
+		return;
+	if (idx >= remote->nbintab) {
+		size = idx+16;
+		if (size > BIN_MAXTAB)
+			size = BIN_MAXTAB;
+		remote->bintab = realloc(remote->bintab, sizeof(*remote->bintab)*size);
+		if (!remote->bintab)
+			elog(LOG_CRIT, errno, "realloc");
+		memset(remote->bintab+remote->nbintab, 0,
+				sizeof(*remote->bintab)*(size-remote->nbintab));
+		remote->nbintab = size;
+	}
+	remote->bintab[idx] = par;
+	par->binidx = idx;
+}
+
+/* process 1 received datagram, pktbuf is null terminated */
+static void netio_recv_pkt(struct iosocket *sk, char *pktbuf, int recvlen,
+		union sockaddrs *pname, socklen_t namelen)
+{
+	struct ioremote *remote;
+	struct sockparam *par;
+	int fd = sk->fd, saved_remote_flags;
+	char *tok, *dat, *savedstr;
+	double value;
+	union sockaddrs name = *pname;
 
 	/* find remote */
-	for (remote = sk->remotes; remote; remote = remote->next) {
-		if ((namelen == remote->namelen) &&
-				!memcmp(&remote->name, &name, namelen))
-			break;
-	}
+	remote = find_ioremote(sk, &name, namelen);
 	if (!remote) {
 		/* create remote? */
 		remote = zalloc(sizeof(*remote));
@@ -328,6 +1182,13 @@ static void read_iosocket(int fd, void *data)
 		libt_add_timeout(2*NETIO_PINGTIME, netio_lost_remote, remote);
 	}
 
+	if ((recvlen >= BIN_HDRLEN) && !pktbuf[0]) {
+		/* binary packet */
+		if (!(sk->flags & FL_MYPUBLIC_SOCK))
+			netio_recv_bin(remote, (unsigned char *)pktbuf, recvlen);
+		return;
+	}
+
 	/* parse packet */
 	saved_remote_flags = remote->flags;
 	for (tok = strtok_r(pktbuf, "\n", &savedstr); tok; tok = strtok_r(NULL, "\n", &savedstr)) {
@@ -352,13 +1213,49 @@ static void read_iosocket(int fd, void *data)
 						netio_lost_remote, remote);
 				/* mark this as consumer (= send data) */
 				remote->flags |= FL_SENDTO;
+				if (!strncmp(tok, "*subscribe bin ", 15)) {
+					/* the subscriber tells which name table it has */
+					if (!(remote->flags & FL_BINARY) ||
+							(strtol(tok+15, NULL, 10) != localgen))
+						/* (re)send the name table */
+						remote->bingen = remote->tabgen = -1;
+					remote->flags |= FL_BINARY;
+				} else
+					remote->flags &= ~FL_BINARY;
+			} else if (!strncmp(tok, "*initial bin ", 13)) {
+				if (sk->flags & FL_MYPUBLIC_SOCK)
+					continue;
+				/* new name table follows */
+				bintab_clear(remote);
+				remote->bingen = strtoul(tok+13, &tok, 10);
+				/* older publishers don't tell the count */
+				remote->binexpect = strtoul(tok, NULL, 10);
+				remote->flags |= FL_BINARY;
+			} else if (!strncmp(tok, "*name ", 6)) {
+				if (!(sk->flags & FL_MYPUBLIC_SOCK))
+					netio_recv_binname(remote, tok+6);
 			} else if (!strncmp(tok, "*msg ", 5) || !strncmp(tok, "*ack ", 5)) {
 				struct netiomsg *msg;
-				int id;
+				int id, len, request = tok[1] == 'm';
                                 
 				id = strtoul(tok+5, &tok, 0);
 				if (*tok == ' ')
 					++tok;
+				if (request && !strcmp(tok, "*stats")) {
+					/* answer event loop statistics directly */
+					char pkt[NETIO_MTU+1];
+
+					len = snprintf(pkt, NETIO_MTU, "*ack %u ", id);
+					len += loopstat_format(pkt+len, NETIO_MTU-len);
+					len += snprintf(pkt+len, NETIO_MTU-len,
+							" tx=%lu/%lu rx=%lu/%lu",
+							netstat.sentpkts, netstat.sendcalls,
+							netstat.recvpkts, netstat.recvcalls);
+					if (len >= NETIO_MTU)
+						len = NETIO_MTU-1;
+					sendto(fd, pkt, len, 0, &name.sa, namelen);
+					continue;
+				}
 				/* fill new netiomsg */
 				msg = zalloc(sizeof(*msg) + strlen(tok));
 				msg->id = id;
@@ -387,11 +1284,15 @@ static void read_iosocket(int fd, void *data)
 			}
 			/* assign */
 			*dat++ = 0;
-			par = find_param(tok, remote->params);
+			par = find_param(tok, &remote->params);
 			if (!par)
 				/* TODO: auto-create */
 				break;
-			par->iopar.value = strtod(dat, NULL);
+			value = strtod(dat, NULL);
+			if (value != par->iopar.value)
+				/* keep the edges of a burst */
+				iopar_notify_pending(&par->iopar);
+			par->iopar.value = value;
 			iopar_set_dirty(&par->iopar);
 			iopar_set_present(&par->iopar);
 			if (libio_trace >= 3)
@@ -404,7 +1305,7 @@ static void read_iosocket(int fd, void *data)
 			}
 			/* write request for local parameter */
 			*dat++ = 0;
-			par = find_param(tok, localparams);
+			par = find_param(tok, &localparams);
 			if (!par)
 				break;
 			if (!(par->state & ST_WRITABLE)) {
@@ -416,6 +1317,7 @@ static void read_iosocket(int fd, void *data)
 			netio_dirty = 1;
 			/* set parameter */
 			par->iopar.value = strtod(dat, NULL);
+			par->state |= ST_CHANGED;
 			iopar_set_dirty(&par->iopar);
 			if (libio_trace >= 3)
 				fprintf(stderr, "netio:%s %s\n", par->name, dat);
@@ -423,15 +1325,19 @@ static void read_iosocket(int fd, void *data)
 		}
 	}
 	/* actions for remote */
-	if ((remote->flags ^ saved_remote_flags) & FL_SENDTO) {
-		int len = 0;
-		/* new consumer, emit all params */
-		len += snprintf(pktbuf+len, NETIO_MTU-len, "*initial\n");
-		for (len = 0, par = localparams; par; par = par->next) {
-			len += snprintf(pktbuf+len, NETIO_MTU-len, "%s=%lf\n",
-					par->name, par->iopar.value);
+	if ((remote->flags & FL_SENDTO) && (remote->flags & FL_BINARY) &&
+			(remote->bingen != localgen)) {
+		/* new binary consumer, or its name table changed */
+		if (netio_send_binstate(remote) < 0) {
+			elog(LOG_WARNING, errno, "send initial packet");
+			remote->flags &= ~(FL_SENDTO | FL_BINARY);
 		}
-		if (sendto(fd, pktbuf, len, 0, &remote->name.sa, remote->namelen) < 0) {
+	} else if (((remote->flags ^ saved_remote_flags) & FL_SENDTO) ||
+			((saved_remote_flags & FL_BINARY) && !(remote->flags & FL_BINARY))) {
+		/* new consumer, emit all params */
+		netio_fill_local(remote_mtu(remote), "*initial\n");
+		/* a full socket will resync all params later */
+		if (netio_send_pkts(remote, &txtq, 0) < 0) {
 			elog(LOG_WARNING, errno, "send initial packet");
 			/* clear flag */
 			remote->flags &= ~FL_SENDTO;
@@ -439,6 +1345,116 @@ static void read_iosocket(int fd, void *data)
 	}
 }
 
+__attribute__((destructor))
+static void free_rx(void)
+{
+	if (rx.buf)
+		free(rx.buf);
+	memset(&rx, 0, sizeof(rx));
+}
+
+static inline char *rx_buf(int j)
+{
+	return rx.buf + j*(rx.bufsize+1);
+}
+
+static void rx_alloc(void)
+{
+	if (rx.buf)
+		return;
+	rx.bufsize = NETIO_MAXMTU;
+	rx.nbufs = NETIO_RECVBATCH;
+	/* no zalloc, leave untouched pages alone */
+	rx.buf = malloc(rx.nbufs*(rx.bufsize+1));
+	if (!rx.buf)
+		elog(LOG_CRIT, errno, "malloc");
+}
+
+/* drain the socket, in batches of datagrams */
+static int netio_recv_batch(struct iosocket *sk, struct mmsghdr *msgs,
+		union sockaddrs *names)
+{
+	static int norecvmmsg;
+	struct iovec iov[NETIO_RECVBATCH];
+	int j, ret;
+
+	for (j = 0; j < rx.nbufs; ++j) {
+		iov[j].iov_base = rx_buf(j);
+		iov[j].iov_len = rx.bufsize;
+		memset(&msgs[j], 0, sizeof(msgs[j]));
+		msgs[j].msg_hdr.msg_name = &names[j];
+		msgs[j].msg_hdr.msg_namelen = sizeof(names[j]);
+		msgs[j].msg_hdr.msg_iov = &iov[j];
+		msgs[j].msg_hdr.msg_iovlen = 1;
+	}
+	if (!norecvmmsg) {
+		ret = recvmmsg(sk->fd, msgs, rx.nbufs, MSG_DONTWAIT, NULL);
+		if ((ret >= 0) || (errno != ENOSYS))
+			goto done;
+		norecvmmsg = 1;
+	}
+	ret = recvfrom(sk->fd, rx_buf(0), rx.bufsize, MSG_DONTWAIT | MSG_TRUNC,
+			&names[0].sa, &msgs[0].msg_hdr.msg_namelen);
+	if (ret >= 0) {
+		if (ret > rx.bufsize) {
+			/* real length with MSG_TRUNC */
+			msgs[0].msg_hdr.msg_flags |= MSG_TRUNC;
+			ret = rx.bufsize;
+		}
+		msgs[0].msg_len = ret;
+		ret = 1;
+	}
+done:
+	++netstat.recvcalls;
+	if (ret > 0)
+		netstat.recvpkts += ret;
+	return ret;
+}
+
+static void read_iosocket(int fd, void *data)
+{
+	static int warned;
+	struct iosocket *sk = data;
+	struct mmsghdr msgs[NETIO_RECVBATCH];
+	union sockaddrs names[NETIO_RECVBATCH];
+	int j, k, ret;
+
+	if (libe_revents() & LIBE_OUT) {
+		netio_retry(sk);
+		if (!(libe_revents() & ~LIBE_OUT))
+			return;
+	}
+	rx_alloc();
+	/* the notifiers run once, after all datagrams */
+	for (k = 0; k < NETIO_RECVLOOPS; ++k) {
+		ret = netio_recv_batch(sk, msgs, names);
+		if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+					(errno == EINTR)))
+			return;
+		if (ret < 0) {
+			libe_remove_fd(fd);
+			libt_remove_timeout(netio_retry, sk);
+			close(fd);
+			/* TODO: proper cleanup */
+			return;
+		}
+		for (j = 0; j < ret; ++j) {
+			if (msgs[j].msg_hdr.msg_flags & MSG_TRUNC) {
+				if (!warned++)
+					elog(LOG_WARNING, 0, "netio: datagram above mtu %i dropped",
+							rx.bufsize);
+				continue;
+			}
+			rx_buf(j)[msgs[j].msg_len] = 0;
+			netio_recv_pkt(sk, rx_buf(j), msgs[j].msg_len,
+					&names[j], msgs[j].msg_hdr.msg_namelen);
+		}
+		if (ret < rx.nbufs)
+			/* drained */
+			return;
+	}
+}
+
 /* socket creation */
 static int netio_autobind(int family)
 {
@@ -451,7 +1467,7 @@ static int netio_autobind(int family)
 
 	ret = sk = socket(family, SOCK_DGRAM/* | SOCK_CLOEXEC*/, 0);
 	if (ret < 0) {
-		elog(LOG_WARNING, errno, "socket %i dgram 0", name.sa.sa_family);
+		elog(LOG_WARNING, errno, "socket %i dgram 0", family);
 		return -1;
 	}
 	fcntl(sk, F_SETFD, fcntl(sk, F_GETFD) | FD_CLOEXEC);
@@ -470,7 +1486,7 @@ static int netio_autobind(int family)
 	iosock = zalloc(sizeof(*iosock));
 	iosock->fd = sk;
 	libe_add_fd(sk, read_iosocket, iosock);
-	iosockets[name.sa.sa_family] = iosock;
+	iosockets[family] = iosock;
 	netio_schedule_keepalive();
 	return sk;
 }
@@ -552,6 +1568,8 @@ static int set_sockparam(struct iopar *iopar, double value)
 		par->state |= ST_WAITING;
 	} else {
 		iopar_set_present(iopar);
+		if (par->iopar.value != value)
+			par->state |= ST_CHANGED;
 		par->iopar.value = value;
 	}
 	netio_dirty = 1;
@@ -564,14 +1582,14 @@ static void del_sockparam_hook(struct iopar *iopar)
 
 	del_sockparam(par);
 	cleanup_libiopar(&par->iopar);
-	free(par);
+	iopar_free(par);
 }
 
 struct iopar *mknetiolocal(char *name)
 {
 	struct sockparam *par;
 
-	par = zalloc(sizeof(*par) + strlen(name));
+	par = iopar_zalloc(sizeof(*par) + strlen(name));
 	if (*name == '+') {
 		par->state |= ST_WRITABLE;
 		++name;
@@ -594,7 +1612,7 @@ static struct iopar *mknetioremote(const char *uri, int family)
 	struct sockparam *par;
 	struct ioremote *remote;
 	struct iosocket *sock;
-	char *parname;
+	char *parname, *opts;
 	union sockaddrs name;
 	int namelen, ret;
 
@@ -608,7 +1626,7 @@ static struct iopar *mknetioremote(const char *uri, int family)
 		goto fail_family;
 	}
 
-	par = zalloc(sizeof(*par) + strlen(parname));
+	par = iopar_zalloc(sizeof(*par) + strlen(parname));
 	strcpy(par->name, parname);
 	par->iopar.del = del_sockparam_hook;
 	par->iopar.set = set_sockparam;
@@ -620,18 +1638,16 @@ static struct iopar *mknetioremote(const char *uri, int family)
 	namelen = netio_strtosockname(uri, &name.sa, family);
 	if (namelen < 0)
 		goto fail_sockname;
-	for (remote = sock->remotes; remote; remote = remote->next) {
-		if (remote->namelen == namelen &&
-				!memcmp(&remote->name, &name, namelen))
-			break;
-	}
-
+	remote = find_ioremote(sock, &name, namelen);
 	if (!remote) {
 		remote = zalloc(sizeof(*remote));
 		remote->namelen = namelen;
 		memcpy(&remote->name, &name, namelen);
 		add_ioremote(remote, sock);
-		ret = sendto(sock->fd, "*subscribe\n", 10, 0, &name.sa, namelen);
+		opts = strchr(uri, '?');
+		if (opts && (opts < parname) && !strncmp(opts+1, "text", 4))
+			remote->flags |= FL_TEXT;
+		ret = netio_subscribe(remote);
 		if ((ret < 0) && (errno != ECONNREFUSED)) {
 			elog(LOG_WARNING, errno, "subscribe failed");
 			del_ioremote(remote);
@@ -639,6 +1655,10 @@ static struct iopar *mknetioremote(const char *uri, int family)
 			goto fail_subscribe;
 		}
 		libt_add_timeout(2*NETIO_PINGTIME, netio_lost_remote, remote);
+	} else if (remote->flags & FL_BINARY) {
+		/* get a name table with my new param */
+		bintab_clear(remote);
+		netio_subscribe(remote);
 	}
 
 	add_sockparam(par, remote);
@@ -646,7 +1666,7 @@ static struct iopar *mknetioremote(const char *uri, int family)
 
 fail_subscribe:
 fail_sockname:
-	free(par);
+	iopar_free(par);
 fail_family:
 fail_noname:
 	return NULL;
@@ -667,34 +1687,87 @@ struct iopar *mknetioudp6(char *uri)
 
 /* hook into iolib */
 void netio_sync(void)
+{
+	/* flush netiomsg queue */
+	while (netio_recv_msg()) ;
+
+	netio_sync_params();
+}
+
+/* send the datagrams of q to the text or binary subscribers of sk */
+static void netio_fanout(struct iosocket *sk, struct pktq *q, int binary)
 {
 	struct ioremote *remote;
+	int j;
+
+	for (j = 0; j < q->npkts; ++j) {
+		for (remote = sk->remotes; remote; remote = remote->next) {
+			if (remote->flags & FL_BLOCKED)
+				/* waiting for resync */
+				continue;
+			if (!binary && !(remote->flags & FL_BINARY))
+				fan_add(remote);
+			else if (binary && (remote->flags & FL_BINARY) &&
+					(remote->bingen == localgen))
+				fan_add(remote);
+		}
+		netio_fan_send(sk, q->buf + pkt_offset(q, j),
+				q->ends[j] - pkt_offset(q, j));
+	}
+}
+
+/* fill txtq & binq with the changed local parameters */
+static void netio_fill_changes(int mtu)
+{
 	struct sockparam *par;
-	int len, j;
 
-	/* flush netiomsg queue */
-	while (netio_recv_msg()) ;
+	pkt_start(&txtq, mtu, NULL, 0);
+	bin_start(mtu);
+	for (par = localparams; par; par = par->next) {
+		if (!(par->state & (ST_NEW | ST_CHANGED)))
+			continue;
+		pkt_printf(&txtq, "%s=%lf\n",
+				par->name, par->iopar.value);
+		bin_put_param(&binq, par->binidx, par->iopar.value);
+	}
+	pkt_end(&txtq);
+	pkt_end(&binq);
+}
+
+void netio_sync_params(void)
+{
+	struct ioremote *remote;
+	struct sockparam *par;
+	int len, j, mtu;
 
 	if (!netio_dirty)
 		return;
-	/* prepare local parameters update packet */
-	for (len = 0, par = localparams; par; par = par->next) {
-		if (par->state & ST_NEW) {
-			len += snprintf(pktbuf+len, NETIO_MTU-len, "%s=%lf\n",
-					par->name, par->iopar.value);
-			par->state &= ~ST_NEW;
-
-		} else if (par->iopar.state & ST_DIRTY)
-			len += snprintf(pktbuf+len, NETIO_MTU-len, "%s=%lf\n",
-					par->name, par->iopar.value);
+	/* prepare local parameters update packets, text & binary,
+	 * per mtu of the socket families
+	 */
+	for (mtu = 0, j = 0; j < NIOSOCKETS; ++j) {
+		if (!pubsockets[j])
+			continue;
+		if (mtu != netio_mtu(j)) {
+			mtu = netio_mtu(j);
+			netio_fill_changes(mtu);
+		}
+		netio_fanout(pubsockets[j], &txtq, 0);
+		netio_fanout(pubsockets[j], &binq, 1);
 	}
+	/* published, also when the iopars remain dirty until libio_flush */
+	for (par = localparams; par; par = par->next)
+		par->state &= ~(ST_NEW | ST_CHANGED);
 
+	/* name table changed, this reuses txtq & binq */
 	for (j = 0; j < NIOSOCKETS; ++j) {
 		if (!pubsockets[j])
 			continue;
 		for (remote = pubsockets[j]->remotes; remote; remote = remote->next) {
-			/* test if we need to send */
-			if (sendto(pubsockets[j]->fd, pktbuf, len, 0, &remote->name.sa, remote->namelen) < 0)
+			if ((remote->flags & (FL_BINARY | FL_BLOCKED)) != FL_BINARY ||
+					(remote->bingen == localgen))
+				continue;
+			if (netio_send_binstate(remote) < 0)
 				if (errno != ECONNREFUSED)
 					elog(LOG_WARNING, errno, "netio_sync public");
 		}
@@ -705,20 +1778,18 @@ void netio_sync(void)
 		if (!iosockets[j])
 			continue;
 		for (remote = iosockets[j]->remotes; remote; remote = remote->next) {
+			if (remote->flags & FL_BLOCKED)
+				/* params remain waiting */
+				continue;
 			/* add remote waiting parameters */
-			len = 0;
-			for (par = remote->params; par; par = par->next) {
-				if (par->state & ST_WAITING) {
-					len += snprintf(pktbuf+len, NETIO_MTU-len, "%s>%lf\n",
-							par->name, par->newvalue);
-					par->state &= ~ST_WAITING;
-				}
-			}
+			len = netio_fill_writes(remote);
 			/* test if we need to send */
 			if (!len)
 				continue;
-			if (sendto(iosockets[j]->fd, pktbuf, len, 0, &remote->name.sa, remote->namelen) < 0)
+			if (netio_send_pkts(remote, &txtq, 0) < 0)
 				elog(LOG_WARNING, errno, "netio_sync client");
+			if (!(remote->flags & FL_BLOCKED))
+				netio_clr_writes(remote);
 		}
 	}
 	netio_dirty = 0;
@@ -99,41 +99,46 @@ static void del_shared(struct iopar *iopar)
 
 		/* remove master from table */
 		for (pshared = &table; *pshared; pshared = &(*pshared)->next) {
-			if (*pshared == spar->master)
+			if (*pshared == spar->master) {
 				*pshared = spar->master->next;
+				break;
+			}
 		}
+		libio_index_del(&table, spar->master->name, spar->master);
 		destroy_iopar(spar->master->refpar);
 		/* free master, refpar has reverted to default */
 		free(spar->master);
 	}
 
 	cleanup_libiopar(&spar->iopar);
-	free(spar);
+	iopar_free(spar);
 }
 
 struct iopar *mkshared(char *cstr)
 {
 	struct sharedpar *spar;
 	struct shared *shared;
+	struct libio_arena *saved;
 
 	/* lookup shared */
-	for (shared = table; shared; shared = shared->next) {
-		if (!strcmp(shared->name, cstr))
-			break;
-	}
+	shared = libio_index_find(&table, cstr);
 	if (!shared) {
 		/* create new */
 		shared = zalloc(sizeof(*shared) + strlen(cstr));
 		strcpy(shared->name, cstr);
+		/* the master outlives the arena of its first user */
+		saved = libio_set_arena(NULL);
 		shared->refpar = create_iopar(cstr);
+		libio_set_arena(saved);
 		if (shared->refpar < 0)
 			goto fail_refpar;
 		/* register shared in table */
 		shared->next = table;
 		table = shared;
+		libio_index_add(&table, shared->name, shared);
 	}
 
-	spar = zalloc(sizeof(*spar));
+	spar = iopar_zalloc(sizeof(*spar));
 	spar->master = shared;
 	spar->iopar.del = del_shared;
 	spar->iopar.set = set_shared;
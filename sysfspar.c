@@ -9,6 +9,7 @@
 #include <fcntl.h>
 
 #include "lib/libt.h"
+#include "lib/libe.h"
 
 #include "_libio.h"
 
@@ -26,6 +27,11 @@ static const char *const strflags[] = {
 		#define ID_MULTIPLIER	4
 	"max",
 		#define ID_MAX		5
+	"slack",
+		#define ID_SLACK	6
+	"irq",
+		#define ID_IRQ		7
+		#define FL_IRQ		(1 << ID_IRQ)
 	NULL,
 };
 
@@ -36,43 +42,28 @@ struct sysfspar {
 
 	int flags;
 	double delay;
+	double slack;
 	double edge;
 	double hyst;
 	double mul;
 	char *sysfs;
 	char *realsysfs;
+	/* fd watched for sysfs_notify() */
+	int irqfd;
 };
 
-static void sysfspar_read(struct sysfspar *sp, int warn)
+/* process the contents of the sysfs file */
+static void sysfspar_parse(struct sysfspar *sp, const char *buf)
 {
-	int fd, ret;
 	long ivalue;
 	double fvalue;
-	char buf[32], *str;
-
-	/* warn if requested, or param is present */
-	warn |= sp->iopar.state & ST_PRESENT;
-
-	fd = open(sp->realsysfs, O_RDONLY);
-	if (fd < 0) {
-		/* avoid alerting too much */
-		if (warn)
-			elog(LOG_WARNING, errno, "open %s", sp->sysfs);
-		goto fail_open;
-	}
-	ret = read(fd, buf, sizeof(buf)-1);
-	if (ret < 0) {
-		/* avoid alerting too much */
-		if (warn)
-			elog(LOG_WARNING, errno, "read %s", sp->sysfs);
-		goto fail_read;
-	}
-	close(fd);
-	buf[ret] = 0;
+	const char *str;
 
 	str = strpbrk(buf, "01234567890+-.");
-	if (!str)
-		goto fail_parse;
+	if (!str) {
+		iopar_clr_present(&sp->iopar);
+		return;
+	}
 	ivalue = strtoul(str, NULL, 10);
 	fvalue = ivalue * sp->mul;
 	if (!isnan(sp->edge)) {
@@ -100,12 +91,38 @@ static void sysfspar_read(struct sysfspar *sp, int warn)
 	}
 	/* mark as present */
 	iopar_set_present(&sp->iopar);
+}
+
+static void sysfspar_read(struct sysfspar *sp, int warn)
+{
+	int fd, ret;
+	char buf[32];
+
+	/* warn if requested, or param is present */
+	warn |= sp->iopar.state & ST_PRESENT;
+
+	fd = open(sp->realsysfs, O_RDONLY);
+	if (fd < 0) {
+		/* avoid alerting too much */
+		if (warn)
+			elog(LOG_WARNING, errno, "open %s", sp->sysfs);
+		goto fail_open;
+	}
+	ret = read(fd, buf, sizeof(buf)-1);
+	if (ret < 0) {
+		/* avoid alerting too much */
+		if (warn)
+			elog(LOG_WARNING, errno, "read %s", sp->sysfs);
+		goto fail_read;
+	}
+	close(fd);
+	buf[ret] = 0;
+	sysfspar_parse(sp, buf);
 	return;
 
 fail_read:
 	close(fd);
 fail_open:
-fail_parse:
 	iopar_clr_present(&sp->iopar);
 }
 
@@ -117,6 +134,48 @@ static void sysfspar_timeout(void *data)
 	libt_repeat_timeout(sp->delay, sysfspar_timeout, sp);
 }
 
+static void sysfspar_irq(int fd, void *data)
+{
+	struct sysfspar *sp = data;
+	char buf[32];
+	int ret;
+
+	/* reading the attribute re-arms the notification */
+	lseek(fd, 0, SEEK_SET);
+	ret = read(fd, buf, sizeof(buf)-1);
+	if (ret < 0) {
+		if (sp->iopar.state & ST_PRESENT)
+			elog(LOG_WARNING, errno, "read %s", sp->sysfs);
+		iopar_clr_present(&sp->iopar);
+		return;
+	}
+	buf[ret] = 0;
+	sysfspar_parse(sp, buf);
+}
+
+/* wait for sysfs_notify() (EPOLLPRI) instead of polling */
+static int sysfspar_watch(struct sysfspar *sp)
+{
+	char buf[32];
+
+	sp->irqfd = open(sp->realsysfs, O_RDONLY | O_CLOEXEC);
+	if (sp->irqfd < 0) {
+		elog(LOG_WARNING, errno, "open %s", sp->sysfs);
+		return -1;
+	}
+	/* a first read is required before waiting */
+	if (read(sp->irqfd, buf, sizeof(buf)) < 0)
+		goto fail;
+	if (libe_add_fd_flags(sp->irqfd, LIBE_PRI, sysfspar_irq, sp) < 0)
+		goto fail;
+	return 0;
+fail:
+	elog(LOG_WARNING, errno, "watch %s", sp->sysfs);
+	close(sp->irqfd);
+	sp->irqfd = -1;
+	return -1;
+}
+
 static int set_sysfspar(struct iopar *iopar, double value)
 {
 	struct sysfspar *sp = (struct sysfspar *)iopar;
@@ -160,11 +219,15 @@ static void del_sysfspar(struct iopar *iopar)
 	struct sysfspar *sp = (void *)iopar;
 
 	libt_remove_timeout(sysfspar_timeout, sp);
+	if (sp->irqfd >= 0) {
+		libe_remove_fd(sp->irqfd);
+		close(sp->irqfd);
+	}
 	cleanup_libiopar(&sp->iopar);
-	free(sp->sysfs);
+	iopar_free(sp->sysfs);
 	if (sp->realsysfs)
 		free(sp->realsysfs);
-	free(sp);
+	iopar_free(sp);
 }
 
 struct iopar *mksysfspar(char *spec)
@@ -173,22 +236,24 @@ struct iopar *mksysfspar(char *spec)
 	const char *tok;
 	int flag;
 
-	sp = zalloc(sizeof(*sp) + strlen(spec));
+	sp = iopar_zalloc(sizeof(*sp) + strlen(spec));
 	sp->iopar.del = del_sysfspar;
 	sp->iopar.set = set_sysfspar;
 	/* force the first read to mark value as dirty */
-	sp->sysfs = strdup(strtok(spec, ",") ?: "/dev/null");
+	sp->sysfs = iopar_strdup(strtok(spec, ",") ?: "/dev/null");
 	sp->realsysfs = findfile(sp->sysfs);
 	if (!sp->realsysfs) {
 		elog(LOG_WARNING, ENOENT, "glob %s", sp->sysfs);
-		free(sp->sysfs);
-		free(sp);
+		iopar_free(sp->sysfs);
+		iopar_free(sp);
 		return NULL;
 	}
 	sp->edge = NAN;
 	sp->hyst = NAN;
 	sp->delay = 1;
+	sp->slack = NAN;
 	sp->mul = 1;
+	sp->irqfd = -1;
 
 	while (1) {
 		tok = mygetsubopt(strtok(NULL, ","));
@@ -216,17 +281,27 @@ struct iopar *mksysfspar(char *spec)
 		case ID_MAX:
 			sp->mul = 1 / strtod(mygetsuboptvalue() ?: "1", NULL);
 			break;
+		case ID_SLACK:
+			sp->slack = strtod(mygetsuboptvalue() ?: "0", NULL);
+			break;
 		default:
 			sp->flags |= 1 << flag;
 			break;
 		}
 	}
 
+	/* polling may be late by 1/8th of its period by default */
+	if (isnan(sp->slack))
+		sp->slack = sp->delay / 8;
+
 	/* read initial value & schedule next */
 	if (!access(sp->realsysfs, R_OK)) {
-		/* read repeatedly */
 		sysfspar_read(sp, 1);
-		libt_add_timeout(sp->delay, sysfspar_timeout, sp);
+		if ((sp->flags & FL_IRQ) && !sysfspar_watch(sp))
+			/* no need to poll */
+			return &sp->iopar;
+		/* read repeatedly */
+		libt_add_timeout_slack(sp->delay, sp->slack, sysfspar_timeout, sp);
 	}
 	return &sp->iopar;
 }
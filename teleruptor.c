@@ -36,6 +36,8 @@ static void teleruptor_update(struct tr *tr)
 	tr->iopar.value = get_iopar(tr->fdb);
 	if (tobool(saved_value) != tobool(tr->iopar.value))
 		iopar_set_dirty(&tr->iopar);
+	else
+		libio_pack_iopar(&tr->iopar);
 	iopar_set_present(&tr->iopar);
 }
 
@@ -98,7 +100,7 @@ static void del_teleruptor(struct iopar *iopar)
 	destroy_iopar(tr->fdb);
 	destroy_iopar(tr->out);
 	cleanup_libiopar(iopar);
-	free(iopar);
+	iopar_free(iopar);
 }
 
 static void teleruptor_feedback(void *dat)
@@ -119,7 +121,7 @@ struct iopar *mkteleruptor(char *str)
 	struct tr *tr;
 	char *savedstr;
 
-	tr = zalloc(sizeof(*tr));
+	tr = iopar_zalloc(sizeof(*tr));
 	tr->iopar.del = del_teleruptor;
 	tr->iopar.set = set_teleruptor;
 	tr->iopar.value = FP_NAN;
@@ -130,7 +132,10 @@ struct iopar *mkteleruptor(char *str)
 	tr->fdb = create_iopar(strtok_r(NULL, "+", &savedstr));
 	if (tr->fdb < 0)
 		goto fail_fdb;
-	if (iopar_add_notifier(tr->fdb, teleruptor_feedback, tr) < 0)
+	/* only wake up for real changes of the feedback */
+	if (iopar_add_notifier_flags(tr->fdb, teleruptor_feedback, tr,
+				IOPAR_NF_RISING | IOPAR_NF_FALLING |
+				IOPAR_NF_PRESENT, 0, 0) < 0)
 		goto fail_fdb;
 	/* preset initial state */
 	teleruptor_update(tr);
@@ -139,6 +144,6 @@ struct iopar *mkteleruptor(char *str)
 fail_fdb:
 	destroy_iopar(tr->out);
 fail_out:
-	free(tr);
+	iopar_free(tr);
 	return NULL;
 }
@@ -0,0 +1,631 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stddef.h>
+#include <math.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "lib/libe.h"
+#include "lib/libt.h"
+#include "_libio.h"
+
+/* regression tests for libio, run with 'make test' */
+
+static int nfailed;
+
+#define check(cond, fmt, ...) \
+	do { \
+		if (!(cond)) { \
+			++nfailed; \
+			printf("FAIL %s:%i: " fmt "\n", __func__, __LINE__, ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+static void on_cycle(void *dat)
+{
+}
+
+/* run 1 main loop cycle, without sleeping */
+static void cycle(void)
+{
+	libt_add_timeout(0, on_cycle, NULL);
+	libio_wait();
+}
+
+/* expressions follow inputs that the application sets */
+static int ex_n;
+
+static void ex_notified(void *dat)
+{
+	++ex_n;
+}
+
+static void test_expr_app_set(void)
+{
+	int a, x;
+
+	a = create_iopar("netio:test_expr_a");
+	set_iopar(a, 5);
+	x = create_iopar("expr:{netio:test_expr_a}*2+1");
+	check(x > 0, "create expr");
+	cycle();
+	check(get_iopar(x) == 11, "initial %g", get_iopar(x));
+
+	/* set from the main loop, not from a notifier or timer */
+	iopar_add_notifier(x, ex_notified, NULL);
+	set_iopar(a, 7);
+	cycle();
+	check(get_iopar(x) == 15, "after set %g", get_iopar(x));
+	check(ex_n == 1, "expr notified %i times", ex_n);
+	check(iopar_dirty(x), "expr not dirty");
+	cycle();
+	check(ex_n == 1 && !iopar_dirty(x), "expr notified again");
+
+	destroy_iopar(x);
+	destroy_iopar(a);
+}
+
+/* a type that writes other iopars from a notifier, like shared */
+static int pk_a, pk_b;
+
+static void pk_set(void *dat)
+{
+	set_iopar(pk_b, 1);
+	set_iopar(pk_a, 1);
+}
+
+static void pk_on_a(void *dat)
+{
+	struct iopar *iopar = lookup_iopar(pk_b);
+
+	/* pk_b is dirty and packed already */
+	iopar->value = 42;
+	iopar_set_dirty(iopar);
+}
+
+/* bulk readers see what get_iopar() sees */
+static void test_packed_fresh(void)
+{
+	double value;
+
+	pk_a = create_iopar("netio:test_pk_a");
+	pk_b = create_iopar("netio:test_pk_b");
+	/* start the packed store */
+	get_iopars(&pk_b, &value, 1);
+	iopar_add_notifier(pk_a, pk_on_a, NULL);
+	libt_add_timeout(0, pk_set, NULL);
+	libio_wait();
+	get_iopars(&pk_b, &value, 1);
+	check(value == get_iopar(pk_b), "packed %g, get_iopar %g",
+			value, get_iopar(pk_b));
+
+	destroy_iopar(pk_a);
+	destroy_iopar(pk_b);
+
+	/* set by the application, after the notifiers */
+	pk_a = create_iopar("shared:netio:test_pk_sh");
+	pk_b = create_iopar("shared:netio:test_pk_sh");
+	cycle();
+	set_iopar(pk_a, 1);
+	set_iopar(pk_a, 2);
+	get_iopars(&pk_b, &value, 1);
+	check(value == 2, "packed shared %g", value);
+	cycle();
+
+	destroy_iopar(pk_a);
+	destroy_iopar(pk_b);
+}
+
+/* only what changed is dirty, for 1 cycle */
+#define NDIRTY	200
+static int dt_ids[NDIRTY];
+
+static void dt_set(void *dat)
+{
+	set_iopar(dt_ids[7], 1);
+	set_iopar(dt_ids[NDIRTY-1], 1);
+	/* set twice, listed once */
+	set_iopar(dt_ids[7], 2);
+	/* destroyed while dirty */
+	set_iopar(dt_ids[9], 1);
+	destroy_iopar(dt_ids[9]);
+}
+
+static void test_dirty(void)
+{
+	unsigned long mask[IOPAR_MASK_WORDS(NDIRTY)];
+	int j, n, packed;
+
+	for (packed = 0; packed < 2; ++packed) {
+		for (j = 0; j < NDIRTY; ++j)
+			dt_ids[j] = create_ioparf("netio:test_dirty_%i", j);
+		cycle();
+		if (packed)
+			/* start the packed store */
+			get_iopars(dt_ids, (double[NDIRTY]){}, NDIRTY);
+		cycle();
+		n = iopar_dirty_mask(dt_ids, NDIRTY, mask);
+		check(!n, "%i dirty without change", n);
+
+		libt_add_timeout(0, dt_set, NULL);
+		libio_wait();
+		n = iopar_dirty_mask(dt_ids, NDIRTY, mask);
+		check(n == 2, "%i dirty, packed %i", n, packed);
+		check(iopar_mask_test(mask, 7) && iopar_mask_test(mask, NDIRTY-1),
+				"wrong dirty iopars, packed %i", packed);
+		check(iopar_dirty(dt_ids[7]) && !iopar_dirty(dt_ids[8]),
+				"iopar_dirty, packed %i", packed);
+
+		cycle();
+		n = iopar_dirty_mask(dt_ids, NDIRTY, mask);
+		check(!n, "%i still dirty, packed %i", n, packed);
+
+		for (j = 0; j < NDIRTY; ++j) {
+			if (j != 9)
+				destroy_iopar(dt_ids[j]);
+		}
+	}
+}
+
+/* a destroyed iopar's id does not reach the next iopar in its slot */
+static void test_stale_id(void)
+{
+	unsigned long mask[1];
+	int a, b, j, k, ids[2], prev[64];
+	double values[2];
+
+	a = create_iopar("netio:test_stale_a");
+	set_iopar(a, 1);
+	destroy_iopar(a);
+	b = create_iopar("netio:test_stale_b");
+	check(b > 0 && b != a, "reused id %i", b);
+	set_iopar(b, 2);
+
+	errno = 0;
+	check(isnan(get_iopar(a)) && errno == ENODEV, "stale get_iopar");
+	errno = 0;
+	check(set_iopar(a, 3) < 0 && errno == ENODEV, "stale set_iopar");
+	check(!lookup_iopar(a), "stale lookup_iopar");
+	check(!iopar_dirty(a), "stale iopar_dirty");
+	check(get_iopar(b) == 2, "b %g", get_iopar(b));
+
+	/* bulk calls, via the packed store */
+	ids[0] = a;
+	ids[1] = b;
+	errno = 0;
+	check(get_iopars(ids, values, 2) < 0 && errno == ENODEV,
+			"stale get_iopars");
+	check(isnan(values[0]) && values[1] == 2, "get_iopars %g %g",
+			values[0], values[1]);
+	iopar_dirty_mask(ids, 2, mask);
+	check(!iopar_mask_test(mask, 0) && iopar_mask_test(mask, 1),
+			"stale iopar_dirty_mask");
+	cycle();
+	destroy_iopar(b);
+
+	/* recycled slots get new ids each time */
+	for (j = 0; j < 64; ++j) {
+		prev[j] = create_ioparf("netio:test_stale_%i", j);
+		check(prev[j] > 0, "create %i", j);
+		for (k = 0; k < j; ++k)
+			check(prev[j] != prev[k], "id %i reused by %i", k, j);
+		destroy_iopar(prev[j]);
+		check(!lookup_iopar(prev[j]), "destroyed %i", j);
+	}
+
+	/* more reuses than generations */
+	a = create_iopar("netio:test_stale_a");
+	destroy_iopar(a);
+	for (j = 0; j < 4096; ++j) {
+		b = create_iopar("netio:test_stale_b");
+		if (b == a)
+			break;
+		destroy_iopar(b);
+	}
+	check(b != a, "id %i reused after %i iopars", a, j);
+	check(!lookup_iopar(a), "stale lookup_iopar after %i iopars", j);
+	if (b == a)
+		destroy_iopar(b);
+}
+
+/* transactions */
+static int tx_x, tx_y, tx_ny;
+
+static void tx_on_x(void *dat)
+{
+	/* commit from a notifier */
+	libio_begin();
+	set_iopar(tx_y, get_iopar(tx_x));
+	libio_commit();
+}
+
+static void tx_on_y(void *dat)
+{
+	++tx_ny;
+}
+
+static void tx_set_x(void *dat)
+{
+	set_iopar(tx_x, 3);
+}
+
+/* commits to iopars that are dirty already */
+static int tx_p, tx_q, tx_np;
+static double tx_pvalue;
+
+static void tx_on_p(void *dat)
+{
+	++tx_np;
+	tx_pvalue = get_iopar(tx_p);
+}
+
+static void tx_on_q(void *dat)
+{
+	libio_begin();
+	set_iopar(tx_p, 9);
+	libio_commit();
+}
+
+static void tx_set_pq(void *dat)
+{
+	/* p is notified before q, or after */
+	set_iopar(dat ? tx_q : tx_p, 1);
+	set_iopar(dat ? tx_p : tx_q, 1);
+}
+
+static void test_txn_dirty(void)
+{
+	int order;
+
+	tx_p = create_iopar("netio:test_txn_p");
+	tx_q = create_iopar("netio:test_txn_q");
+	cycle();
+	iopar_add_notifier(tx_p, tx_on_p, NULL);
+
+	/* from the application */
+	set_iopar(tx_p, 1);
+	libio_begin();
+	set_iopar(tx_p, 2);
+	libio_commit();
+	check(tx_np == 1 && tx_pvalue == 2, "app: %i notifications, value %g",
+			tx_np, tx_pvalue);
+	cycle();
+
+	/* from a notifier */
+	iopar_add_notifier(tx_q, tx_on_q, NULL);
+	for (order = 0; order < 2; ++order) {
+		set_iopar(tx_p, 0);
+		set_iopar(tx_q, 0);
+		cycle();
+		tx_np = 0;
+		libt_add_timeout(0, tx_set_pq, (void *)(long)order);
+		libio_wait();
+		check(tx_np >= 1 && tx_pvalue == 9, "order %i: value %g",
+				order, tx_pvalue);
+		/* when p comes after q, the running loop sees 9 at once */
+		check(tx_np == (order ? 1 : 2), "order %i: %i notifications",
+				order, tx_np);
+	}
+	destroy_iopar(tx_p);
+	destroy_iopar(tx_q);
+}
+
+static void test_txn(void)
+{
+	int a, b, j, ids[64];
+
+	a = create_iopar("netio:test_txn_a");
+	b = create_iopar("netio:test_txn_b");
+	set_iopar(a, 1);
+	set_iopar(b, 1);
+	cycle();
+
+	libio_begin();
+	set_iopar(a, 2);
+	set_iopar(a, 3);
+	check(get_iopar(a) == 3, "staged %g", get_iopar(a));
+	libio_begin();
+	set_iopar(b, 4);
+	check(!libio_commit(), "nested commit");
+	check(iopar_dirty(b) == 0, "nested commit applied");
+	check(!libio_commit(), "commit");
+	check(get_iopar(a) == 3 && get_iopar(b) == 4, "applied %g %g",
+			get_iopar(a), get_iopar(b));
+	check(libio_commit() < 0 && errno == EINVAL, "commit without begin");
+
+	/* a staged iopar that is destroyed before the commit */
+	libio_begin();
+	set_iopar(b, 5);
+	destroy_iopar(b);
+	check(libio_commit() < 0 && errno == ENODEV, "destroyed while staged");
+
+	/* many staged sets */
+	for (j = 0; j < 64; ++j)
+		ids[j] = create_ioparf("netio:test_txn_%i", j);
+	libio_begin();
+	for (j = 0; j < 64*4; ++j)
+		set_iopar(ids[j % 64], j);
+	for (j = 0; j < 64; ++j)
+		check(get_iopar(ids[j]) == 64*3 + j, "staged %i", j);
+	libio_commit();
+	for (j = 0; j < 64; ++j) {
+		check(get_iopar(ids[j]) == 64*3 + j, "applied %i", j);
+		destroy_iopar(ids[j]);
+	}
+
+	/* a commit inside a notifier notifies the outer loop only once */
+	tx_x = create_iopar("netio:test_txn_x");
+	tx_y = create_iopar("netio:test_txn_y");
+	iopar_add_notifier(tx_x, tx_on_x, NULL);
+	iopar_add_notifier(tx_y, tx_on_y, NULL);
+	libt_add_timeout(0, tx_set_x, NULL);
+	libio_wait();
+	check(tx_ny == 1, "notified %i times", tx_ny);
+	check(get_iopar(tx_y) == 3, "y %g", get_iopar(tx_y));
+
+	destroy_iopar(tx_x);
+	destroy_iopar(tx_y);
+	destroy_iopar(a);
+}
+
+/* a committed change is published once */
+static void test_txn_netio(void)
+{
+	struct sockaddr_un pub = { .sun_family = AF_UNIX, };
+	struct sockaddr_un sub = { .sun_family = AF_UNIX, };
+	socklen_t publen;
+	char buf[1024];
+	int a, b, fd, ret, na = 0;
+
+	if (libio_bind_net("unix:@testlibio") < 0) {
+		check(0, "bind");
+		return;
+	}
+	a = create_iopar("netio:test_pub_a");
+	b = create_iopar("netio:test_pub_b");
+	fd = socket(PF_UNIX, SOCK_DGRAM, 0);
+	strcpy(sub.sun_path+1, "testlibio-sub");
+	bind(fd, (void *)&sub, offsetof(struct sockaddr_un, sun_path) + 1 +
+			strlen("testlibio-sub"));
+	strcpy(pub.sun_path+1, "testlibio");
+	publen = offsetof(struct sockaddr_un, sun_path) + 1 + strlen("testlibio");
+	/* subscribe as text */
+	sendto(fd, "*subscribe\n", 11, 0, (void *)&pub, publen);
+	cycle();
+	while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0);
+
+	libio_begin();
+	set_iopar(a, 1);
+	libio_commit();
+	/* something else changes before libio_flush() */
+	set_iopar(b, 1);
+	cycle();
+	while ((ret = recv(fd, buf, sizeof(buf)-1, MSG_DONTWAIT)) > 0) {
+		buf[ret] = 0;
+		if (strstr(buf, "test_pub_a="))
+			++na;
+	}
+	check(na == 1, "a sent %i times", na);
+
+	close(fd);
+	destroy_iopar(a);
+	destroy_iopar(b);
+}
+
+/* datagrams above our own mtu are received,
+ * from remotes with another mtu. Uses the socket of test_txn_netio
+ */
+static void test_big_dgram(void)
+{
+	struct sockaddr_un pub = { .sun_family = AF_UNIX, };
+	static char buf[20000];
+	int a, fd, len;
+
+	a = create_iopar("netio:+test_big");
+	set_iopar(a, 0);
+	cycle();
+	fd = socket(PF_UNIX, SOCK_DGRAM, 0);
+	strcpy(pub.sun_path+1, "testlibio");
+	/* lines without '=' or '>' are ignored */
+	memset(buf, '\n', sizeof(buf));
+	len = sizeof(buf) -1 - strlen("test_big>5\n");
+	strcpy(buf + len, "test_big>5\n");
+	sendto(fd, buf, sizeof(buf)-1, 0, (void *)&pub,
+			offsetof(struct sockaddr_un, sun_path) + 1 + strlen("testlibio"));
+	cycle();
+	check(get_iopar(a) == 5, "big datagram: %g", get_iopar(a));
+	close(fd);
+	destroy_iopar(a);
+}
+
+/* a binary subscriber with an old name table gets the new one,
+ * also after 256 changes. Uses the socket of test_txn_netio
+ */
+static int bg_recv(int fd, int *gen)
+{
+	char buf[1024], *str;
+	int ret, ntab = 0;
+
+	while ((ret = recv(fd, buf, sizeof(buf)-1, MSG_DONTWAIT)) > 0) {
+		buf[ret] = 0;
+		str = strstr(buf, "*initial bin ");
+		if (str) {
+			*gen = strtol(str+13, NULL, 10);
+			++ntab;
+		}
+	}
+	return ntab;
+}
+
+static void test_bin_gen(void)
+{
+	struct sockaddr_un pub = { .sun_family = AF_UNIX, };
+	struct sockaddr_un sub = { .sun_family = AF_UNIX, };
+	socklen_t publen;
+	char pkt[64];
+	int a, fd, j, gen = -1, newgen = -1;
+
+	a = create_iopar("netio:test_gen_a");
+	fd = socket(PF_UNIX, SOCK_DGRAM, 0);
+	strcpy(sub.sun_path+1, "testlibio-gen");
+	bind(fd, (void *)&sub, offsetof(struct sockaddr_un, sun_path) + 1 +
+			strlen("testlibio-gen"));
+	strcpy(pub.sun_path+1, "testlibio");
+	publen = offsetof(struct sockaddr_un, sun_path) + 1 + strlen("testlibio");
+	sendto(fd, "*subscribe bin -1\n", 18, 0, (void *)&pub, publen);
+	cycle();
+	check(bg_recv(fd, &gen) == 1 && gen >= 0, "no name table");
+
+	for (j = 0; j < 128; ++j)
+		destroy_iopar(create_ioparf("netio:test_gen_%i", j));
+	cycle();
+	bg_recv(fd, &newgen);
+	/* resubscribe with the table from before */
+	sprintf(pkt, "*subscribe bin %i\n", gen);
+	sendto(fd, pkt, strlen(pkt), 0, (void *)&pub, publen);
+	cycle();
+	check(bg_recv(fd, &newgen) == 1, "old name table %i accepted", gen);
+	check(newgen != gen, "name table %i after 256 changes", newgen);
+
+	close(fd);
+	destroy_iopar(a);
+}
+
+/* a burst of datagrams keeps every change of a remote param */
+static int bu_btn, bu_n;
+static double bu_values[8];
+
+static void bu_notified(void *dat)
+{
+	if (bu_n < 8)
+		bu_values[bu_n] = get_iopar(bu_btn);
+	++bu_n;
+}
+
+static void test_burst(void)
+{
+	struct sockaddr_un pub = { .sun_family = AF_UNIX, };
+	struct sockaddr_un sub;
+	socklen_t sublen = sizeof(sub);
+	char buf[1024];
+	int fd, j;
+
+	fd = socket(PF_UNIX, SOCK_DGRAM, 0);
+	strcpy(pub.sun_path+1, "testlibio-burst");
+	bind(fd, (void *)&pub, offsetof(struct sockaddr_un, sun_path) + 1 +
+			strlen("testlibio-burst"));
+	bu_btn = create_iopar("unix:@testlibio-burst?text#btn");
+	/* the subscription tells where to send to */
+	if (recvfrom(fd, buf, sizeof(buf), 0, (void *)&sub, &sublen) < 0) {
+		check(0, "no subscription");
+		return;
+	}
+	sendto(fd, "btn=0\n", 6, 0, (void *)&sub, sublen);
+	cycle();
+	iopar_add_notifier(bu_btn, bu_notified, NULL);
+
+	/* a short press, received in 1 wakeup */
+	sendto(fd, "btn=1\n", 6, 0, (void *)&sub, sublen);
+	sendto(fd, "btn=0\n", 6, 0, (void *)&sub, sublen);
+	sendto(fd, "btn=1\n", 6, 0, (void *)&sub, sublen);
+	sendto(fd, "btn=1\n", 6, 0, (void *)&sub, sublen);
+	sendto(fd, "btn=0\n", 6, 0, (void *)&sub, sublen);
+	cycle();
+	check(bu_n == 4, "%i notifications", bu_n);
+	for (j = 0; j < 4 && j < bu_n; ++j)
+		check(bu_values[j] == !(j & 1), "notification %i: %g",
+				j, bu_values[j]);
+	destroy_iopar(bu_btn);
+	close(fd);
+}
+
+/* a file that epoll refuses leaves no event behind */
+static void le_read(int fd, void *dat)
+{
+}
+
+static void test_libe_add_fail(void)
+{
+	int fd;
+
+	/* start epoll */
+	cycle();
+	fd = open("/dev/null", O_RDONLY);
+	check(libe_add_fd(fd, le_read, NULL) < 0, "epoll on /dev/null");
+	check(libe_get_flags(fd) < 0, "event left behind");
+	errno = 0;
+	check(libe_add_fd(fd, le_read, NULL) < 0 && errno != EEXIST,
+			"add again: %s", strerror(errno));
+	libe_remove_fd(fd);
+	close(fd);
+}
+
+/* the loop is measured once the stats are requested */
+static void ls_notified(void *dat)
+{
+}
+
+static void ls_set(void *dat)
+{
+	set_iopar(*(int *)dat, 1);
+}
+
+static void test_loopstat(void)
+{
+	struct libio_loopstat st;
+	struct libio_cbstat cbs[16];
+	char buf[1024];
+	int a, j, n;
+
+	if (getenv("LIBIO_LOOPSTAT"))
+		/* measured from the start */
+		return;
+	/* the first reply tells, instead of reporting zeros */
+	loopstat_format(buf, sizeof(buf));
+	check(!strcmp(buf, "loopstat=off enabled=now"), "first reply %s", buf);
+	/* the tests before ran without stats */
+	libio_get_loopstat(&st);
+	check(!st.iterations, "%lu iterations before", st.iterations);
+
+	a = create_iopar("netio:test_loopstat");
+	iopar_add_notifier(a, ls_notified, NULL);
+	libt_add_timeout(0, ls_set, &a);
+	libio_wait();
+	libio_get_loopstat(&st);
+	check(st.iterations == 1, "%lu iterations", st.iterations);
+	n = libio_get_cbstats(cbs, 16);
+	for (j = 0; j < n; ++j) {
+		if (cbs[j].fn == ls_notified)
+			break;
+	}
+	check(j < n && cbs[j].count == 1, "notifier not measured");
+	destroy_iopar(a);
+}
+
+int main(int argc, char *argv[])
+{
+	test_expr_app_set();
+	test_packed_fresh();
+	test_dirty();
+	test_stale_id();
+	test_txn();
+	test_txn_dirty();
+	test_txn_netio();
+	test_big_dgram();
+	test_bin_gen();
+	test_burst();
+	test_libe_add_fail();
+	test_loopstat();
+
+	if (nfailed) {
+		printf("%i checks failed\n", nfailed);
+		return 1;
+	}
+	printf("all tests passed\n");
+	return 0;
+}
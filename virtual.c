@@ -63,7 +63,7 @@ static void del_virtual(struct iopar *iopar)
 	struct virtualpar *virt = (struct virtualpar *)iopar;
 
 	cleanup_libiopar(&virt->iopar);
-	free(virt);
+	iopar_free(virt);
 }
 
 struct iopar *mkvirtual(char *str)
@@ -71,7 +71,7 @@ struct iopar *mkvirtual(char *str)
 	struct virtualpar *virt;
 	char *endp;
 
-	virt = zalloc(sizeof(*virt));
+	virt = iopar_zalloc(sizeof(*virt));
 	virt->mask = 1 << strtoul(str, &endp, 0);
 	if (*endp)
 		virt->mask2 = 1 << strtoul(endp+1, &endp, 0);